@@ -0,0 +1,22 @@
+TARGET = nymea-bluetoothserver-startup-benchmark
+
+QT -= gui
+QT += bluetooth dbus network
+
+QMAKE_CXXFLAGS *= -Werror -std=c++11 -g
+QMAKE_LFLAGS *= -std=c++11
+
+CONFIG += console link_pkgconfig
+CONFIG -= app_bundle
+PKGCONFIG += nymea-networkmanager libsodium
+
+INCLUDEPATH += $$PWD/../../libnymea-bluetoothserver
+LIBS += -L$$OUT_PWD/../../libnymea-bluetoothserver -lnymea-bluetoothserver
+QMAKE_RPATHDIR += $$OUT_PWD/../../libnymea-bluetoothserver
+
+SOURCES += \
+    main.cpp \
+    startupbenchmark.cpp
+
+HEADERS += \
+    startupbenchmark.h
@@ -0,0 +1,117 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "startupbenchmark.h"
+
+#include <QTimer>
+#include <QDebug>
+#include <QMetaEnum>
+#include <QStringList>
+#include <QCoreApplication>
+
+StartupBenchmark::StartupBenchmark(int iterations, QObject *parent) :
+    QObject(parent),
+    m_iterations(iterations)
+{
+    m_server = new BluetoothServer(this);
+    m_server->setRestartDelay(0);
+    connect(m_server, &BluetoothServer::runningChanged, this, &StartupBenchmark::onRunningChanged);
+    connect(m_server, &BluetoothServer::startupFailed, this, &StartupBenchmark::onStartupFailed);
+}
+
+void StartupBenchmark::run()
+{
+    m_server->start();
+}
+
+void StartupBenchmark::printResults()
+{
+    QList<BluetoothServer::StartupPhase> phases = {
+        BluetoothServer::StartupPhasePoweringOn,
+        BluetoothServer::StartupPhaseStartingAdvertising,
+        BluetoothServer::StartupPhaseRetrying
+    };
+
+    QMetaEnum phaseEnum = QMetaEnum::fromType<BluetoothServer::StartupPhase>();
+
+    // The first start builds the GATT database, all further ones use the cached service data
+    for (int i = 0; i < m_samples.count(); i++) {
+        QStringList phaseDurations;
+        foreach (BluetoothServer::StartupPhase phase, phases)
+            phaseDurations.append(QString("%1 %2 ms").arg(phaseEnum.valueToKey(phase)).arg(m_samples.at(i).phaseDurations.value(phase)));
+
+        qInfo().noquote() << QString("Start %1: %2 ms (%3)").arg(i + 1).arg(m_samples.at(i).duration).arg(phaseDurations.join(", "));
+    }
+
+    if (m_samples.count() < 2)
+        return;
+
+    qint64 minimum = m_samples.at(1).duration;
+    qint64 maximum = minimum;
+    qint64 total = 0;
+    for (int i = 1; i < m_samples.count(); i++) {
+        minimum = qMin(minimum, m_samples.at(i).duration);
+        maximum = qMax(maximum, m_samples.at(i).duration);
+        total += m_samples.at(i).duration;
+    }
+
+    qInfo().noquote() << QString("Cold start: %1 ms, cached starts: min %2 ms, avg %3 ms, max %4 ms")
+                         .arg(m_samples.first().duration).arg(minimum).arg(total / (m_samples.count() - 1)).arg(maximum);
+}
+
+void StartupBenchmark::onRunningChanged(bool running)
+{
+    if (!running)
+        return;
+
+    Sample sample;
+    sample.duration = m_server->startupDuration();
+    sample.phaseDurations = m_server->startupPhaseDurations();
+    m_samples.append(sample);
+
+    // Note: stop from the event loop, the server is still handling the controller state change
+    QTimer::singleShot(0, this, [this](){
+        m_server->stop();
+        if (m_samples.count() >= m_iterations) {
+            printResults();
+            qApp->exit(0);
+            return;
+        }
+
+        m_server->start();
+    });
+}
+
+void StartupBenchmark::onStartupFailed()
+{
+    qWarning() << "Could not start the bluetooth server after" << m_samples.count() << "successful starts.";
+    printResults();
+    qApp->exit(1);
+}
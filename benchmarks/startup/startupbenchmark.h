@@ -0,0 +1,66 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STARTUPBENCHMARK_H
+#define STARTUPBENCHMARK_H
+
+#include <QList>
+#include <QObject>
+
+#include "bluetoothserver.h"
+
+// Starts and stops the server repeatedly and reports the time from start() until advertising
+class StartupBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StartupBenchmark(int iterations, QObject *parent = nullptr);
+
+    void run();
+
+private:
+    struct Sample {
+        qint64 duration = 0;
+        QMap<BluetoothServer::StartupPhase, qint64> phaseDurations;
+    };
+
+    BluetoothServer *m_server = nullptr;
+    int m_iterations = 0;
+    QList<Sample> m_samples;
+
+    void printResults();
+
+private slots:
+    void onRunningChanged(bool running);
+    void onStartupFailed();
+
+};
+
+#endif // STARTUPBENCHMARK_H
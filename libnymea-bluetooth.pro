@@ -1,5 +1,8 @@
 TEMPLATE = subdirs
-SUBDIRS += libnymea-bluetoothserver libnymea-bluetoothclient
+SUBDIRS += libnymea-bluetoothserver libnymea-bluetoothclient tests benchmarks
+
+tests.depends = libnymea-bluetoothserver
+benchmarks.depends = libnymea-bluetoothserver
 
 VERSION_STRING=$$system('dpkg-parsechangelog | sed -n -e "s/^Version: //p"')
 
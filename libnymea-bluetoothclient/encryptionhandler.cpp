@@ -32,8 +32,12 @@
 #include "loggingcategories.h"
 
 #include <sodium.h>
+#include <QtEndian>
 #include <QCryptographicHash>
 
+// The amount of keys a receiver may skip in order to catch up with the sender after lost packages
+static const quint32 maximumKeyIndexGap = 64;
+
 EncryptionHandler::EncryptionHandler(QObject *parent) : QObject(parent)
 {
     if (sodium_init() < 0) {
@@ -64,6 +68,8 @@ void EncryptionHandler::reset()
     m_clientPublicKey.clear();
     m_challenge.clear();
     m_challengeConfirmation.clear();
+    m_rekeyingEnabled = false;
+    resetSessionKeys();
     setReady(false);
 }
 
@@ -110,6 +116,7 @@ bool EncryptionHandler::calculateSharedKey(const QByteArray &clientPublicKey)
     m_sharedKey = QByteArray(reinterpret_cast<const char*>(sharedKey), crypto_box_BEFORENMBYTES);
     Q_ASSERT_X(m_sharedKey.length() == 32, "data length", "The shared key does not have the correct length.");
     qCDebug(dcNymeaBluetoothEncryption()) << "Shared key:" << m_sharedKey.toHex();
+    resetSessionKeys();
 
     return true;
 }
@@ -131,6 +138,8 @@ QByteArray EncryptionHandler::generateChallenge()
 bool EncryptionHandler::verifyChallenge(const QByteArray challengeConfirmation)
 {
     if (m_challengeConfirmation == challengeConfirmation) {
+        // The key ratchet starts counting once the encryption has been established
+        resetSessionKeys();
         setReady(true);
         return true;
     }
@@ -143,22 +152,25 @@ QByteArray EncryptionHandler::encryptData(const QByteArray &data, const QByteArr
     qCDebug(dcNymeaBluetoothEncryption()) << "Encrypting data...";
     Q_ASSERT_X(nonce.length() == crypto_box_NONCEBYTES, "data length", "The nonce does not have the correct length.");
 
+    if (m_sendKey.length() != static_cast<int>(crypto_box_BEFORENMBYTES)) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Failed to encrypt data. There is no shared key available.";
+        return QByteArray();
+    }
+
     /* Note: https://download.libsodium.org/doc/public-key_cryptography/authenticated_encryption.html
      *      unsigned char *c         The encrypted message (length of the data + crypto_box_MACBYTES)
      *      const unsigned char *m   The message to encrypt
      *      unsigned long long mlen  The length of the message to encrypt
      *      const unsigned char *n   The nonce (send in the unencrypted DATA)
-     *      const unsigned char *pk  The public key of the client
-     *      const unsigned char *sk  The private key
+     *      const unsigned char *k   The precalculated session key (equals crypto_box_easy with the key pair for key index 0)
      */
 
     unsigned char encrypted[crypto_box_MACBYTES + data.length()];
-    int result = crypto_box_easy(encrypted,
-                                 reinterpret_cast<const unsigned char *>(data.data()),
-                                 static_cast<unsigned long long>(data.length()),
-                                 reinterpret_cast<const unsigned char *>(nonce.data()),
-                                 reinterpret_cast<const unsigned char *>(m_clientPublicKey.data()),
-                                 reinterpret_cast<const unsigned char *>(m_privateKey.data()));
+    int result = crypto_box_easy_afternm(encrypted,
+                                         reinterpret_cast<const unsigned char *>(data.data()),
+                                         static_cast<unsigned long long>(data.length()),
+                                         reinterpret_cast<const unsigned char *>(nonce.data()),
+                                         reinterpret_cast<const unsigned char *>(m_sendKey.constData()));
 
     if (result != 0) {
         qCWarning(dcNymeaBluetoothEncryption()) << "Failed to encrypt data. Something went wrong" << result;
@@ -170,33 +182,164 @@ QByteArray EncryptionHandler::encryptData(const QByteArray &data, const QByteArr
     qCDebug(dcNymeaBluetoothEncryption()) << "    Private key       :" << m_privateKey.toHex();
     qCDebug(dcNymeaBluetoothEncryption()) << "    Public key        :" << m_publicKey.toHex();
     qCDebug(dcNymeaBluetoothEncryption()) << "    Client public key :" << m_clientPublicKey.toHex();
+    qCDebug(dcNymeaBluetoothEncryption()) << "    Send key index    :" << m_sendKeyIndex;
     qCDebug(dcNymeaBluetoothEncryption()) << "    Unencrypted data  :" << data.toHex();
     qCDebug(dcNymeaBluetoothEncryption()) << "    Encrypted data    :" << encryptedData.toHex();
 
+    updateSendKey(data.length());
     return encryptedData;
 }
 
 QByteArray EncryptionHandler::decryptData(const QByteArray &data, const QByteArray &nonce)
+{
+    return decryptData(data, nonce, m_receiveKey);
+}
+
+QByteArray EncryptionHandler::encryptPackage(const QByteArray &data)
+{
+    QByteArray nonce = generateNonce();
+    if (m_ready && m_rekeyingEnabled) {
+        // Tell the receiver which key of the chain encrypted this package
+        quint32 keyIndex = qToLittleEndian(m_sendKeyIndex);
+        nonce.replace(crypto_box_NONCEBYTES, sizeof(keyIndex), reinterpret_cast<const char *>(&keyIndex), sizeof(keyIndex));
+    }
+
+    QByteArray encryptedData = encryptData(data, nonce.left(crypto_box_NONCEBYTES));
+    if (encryptedData.isEmpty())
+        return QByteArray();
+
+    return nonce + encryptedData;
+}
+
+QByteArray EncryptionHandler::decryptPackage(const QByteArray &package)
+{
+    if (package.length() < 32) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Failed to decrypt package. The package is shorter than the nonce.";
+        return QByteArray();
+    }
+
+    QByteArray nonce = package.left(crypto_box_NONCEBYTES);
+    QByteArray data = package.mid(32);
+    if (!m_ready || !m_rekeyingEnabled)
+        return decryptData(data, nonce, m_receiveKey);
+
+    quint32 keyIndex = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(package.constData() + crypto_box_NONCEBYTES));
+    if (keyIndex < m_receiveKeyIndex || keyIndex - m_receiveKeyIndex > maximumKeyIndexGap) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Failed to decrypt package. Unexpected key index" << keyIndex << "while using receive key index" << m_receiveKeyIndex;
+        return QByteArray();
+    }
+
+    // Packages may have been lost, catch up with the key chain of the sender
+    QByteArray key = m_receiveKey;
+    for (quint32 index = m_receiveKeyIndex + 1; index <= keyIndex; index++)
+        key = deriveNextKey(key, index);
+
+    QByteArray decryptedData = decryptData(data, nonce, key);
+    if (decryptedData.isNull())
+        return QByteArray();
+
+    // Only follow the key chain once the package has been authenticated
+    if (keyIndex != m_receiveKeyIndex) {
+        m_receiveKey = key;
+        m_receiveKeyIndex = keyIndex;
+        qCDebug(dcNymeaBluetoothEncryption()) << "Switched to receive key index" << m_receiveKeyIndex;
+    }
+
+    return decryptedData;
+}
+
+QByteArray EncryptionHandler::generateNonce(int length)
+{
+    unsigned char nounce[length];
+    randombytes_buf(nounce, length);
+    return QByteArray(reinterpret_cast<const char *>(nounce), length);
+}
+
+int EncryptionHandler::rekeyMessageLimit() const
+{
+    return m_rekeyMessageLimit;
+}
+
+qint64 EncryptionHandler::rekeyByteLimit() const
+{
+    return m_rekeyByteLimit;
+}
+
+void EncryptionHandler::setRekeyLimits(int messageLimit, qint64 byteLimit)
+{
+    m_rekeyMessageLimit = qMax(0, messageLimit);
+    m_rekeyByteLimit = qMax(static_cast<qint64>(0), byteLimit);
+}
+
+bool EncryptionHandler::rekeyingEnabled() const
+{
+    return m_rekeyingEnabled;
+}
+
+void EncryptionHandler::setRekeyingEnabled(bool rekeyingEnabled)
+{
+    m_rekeyingEnabled = rekeyingEnabled;
+}
+
+quint32 EncryptionHandler::sendKeyIndex() const
+{
+    return m_sendKeyIndex;
+}
+
+quint32 EncryptionHandler::receiveKeyIndex() const
+{
+    return m_receiveKeyIndex;
+}
+
+void EncryptionHandler::setReady(bool ready)
+{
+    if (m_ready == ready)
+        return;
+
+    m_ready = ready;
+    emit readyChanged(m_ready);
+}
+
+void EncryptionHandler::resetSessionKeys()
+{
+    m_sendKey = m_sharedKey;
+    m_sendKeyIndex = 0;
+    m_sendMessageCount = 0;
+    m_sendByteCount = 0;
+
+    m_receiveKey = m_sharedKey;
+    m_receiveKeyIndex = 0;
+}
+
+QByteArray EncryptionHandler::decryptData(const QByteArray &data, const QByteArray &nonce, const QByteArray &key)
 {
     qCDebug(dcNymeaBluetoothEncryption()) << "Decrypting data...";
     Q_ASSERT_X(nonce.length() == crypto_box_NONCEBYTES, "data length", "The nonce does not have the correct length.");
 
+    if (key.length() != static_cast<int>(crypto_box_BEFORENMBYTES)) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Failed to decrypt data. There is no shared key available.";
+        return QByteArray();
+    }
+
+    if (data.length() < static_cast<int>(crypto_box_MACBYTES)) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Failed to decrypt data. The data is shorter than the MAC.";
+        return QByteArray();
+    }
+
     /* Note: https://download.libsodium.org/doc/public-key_cryptography/authenticated_encryption.html
      *      unsigned char *m         The decrypted message result
      *      const unsigned char *c   The message to decrypt / cyphertext (length of the encrypted data + crypto_box_MACBYTES)
      *      unsigned long long clen  The length of the message to decrypt
      *      const unsigned char *n   The nonce used while encryption (received in the unencrypted DATA)
-     *      const unsigned char *pk  The public key of the client
-     *      const unsigned char *sk  The private key
+     *      const unsigned char *k   The precalculated session key (equals crypto_box_open_easy with the key pair for key index 0)
      */
 
     unsigned char decrypted[data.length() - crypto_box_MACBYTES];
-    int result = crypto_box_open_easy(decrypted,
-                                      reinterpret_cast<const unsigned char *>(data.data()),
-                                      static_cast<unsigned long long>(data.length()),
-                                      reinterpret_cast<const unsigned char *>(nonce.data()),
-                                      reinterpret_cast<const unsigned char *>(m_clientPublicKey.data()),
-                                      reinterpret_cast<const unsigned char *>(m_privateKey.data()));
+    int result = crypto_box_open_easy_afternm(decrypted,
+                                              reinterpret_cast<const unsigned char *>(data.data()),
+                                              static_cast<unsigned long long>(data.length()),
+                                              reinterpret_cast<const unsigned char *>(nonce.data()),
+                                              reinterpret_cast<const unsigned char *>(key.constData()));
 
     if (result != 0) {
         qCWarning(dcNymeaBluetoothEncryption()) << "Failed to decrypt data. Something went wrong" << result;
@@ -214,18 +357,30 @@ QByteArray EncryptionHandler::decryptData(const QByteArray &data, const QByteArr
     return decryptedData;
 }
 
-QByteArray EncryptionHandler::generateNonce(int length)
+QByteArray EncryptionHandler::deriveNextKey(const QByteArray &key, quint32 keyIndex)
 {
-    unsigned char nounce[length];
-    randombytes_buf(nounce, length);
-    return QByteArray(reinterpret_cast<const char *>(nounce), length);
+    Q_ASSERT_X(key.length() == static_cast<int>(crypto_kdf_KEYBYTES), "data length", "The session key does not have the correct length.");
+
+    // Note: the key index is used as sub key id, so both sides derive the same key for the same index
+    unsigned char nextKey[crypto_box_BEFORENMBYTES];
+    crypto_kdf_derive_from_key(nextKey, crypto_box_BEFORENMBYTES, keyIndex, "nymeakey", reinterpret_cast<const unsigned char *>(key.constData()));
+    QByteArray result(reinterpret_cast<const char *>(nextKey), crypto_box_BEFORENMBYTES);
+    sodium_memzero(nextKey, crypto_box_BEFORENMBYTES);
+    return result;
 }
 
-void EncryptionHandler::setReady(bool ready)
+void EncryptionHandler::updateSendKey(int dataLength)
 {
-    if (m_ready == ready)
+    if (!m_ready || !m_rekeyingEnabled)
         return;
 
-    m_ready = ready;
-    emit readyChanged(m_ready);
+    m_sendMessageCount++;
+    m_sendByteCount += dataLength;
+    if ((m_rekeyMessageLimit > 0 && m_sendMessageCount >= m_rekeyMessageLimit) || (m_rekeyByteLimit > 0 && m_sendByteCount >= m_rekeyByteLimit)) {
+        m_sendKeyIndex++;
+        m_sendKey = deriveNextKey(m_sendKey, m_sendKeyIndex);
+        m_sendMessageCount = 0;
+        m_sendByteCount = 0;
+        qCDebug(dcNymeaBluetoothEncryption()) << "Switched to send key index" << m_sendKeyIndex;
+    }
 }
@@ -56,10 +56,32 @@ public:
 
     QByteArray generateNonce(int length = 32);
 
+    // Packages start with a 32 byte nonce field followed by the encrypted data. The first 24 bytes
+    // are the nonce, with rekeying enabled the following 4 bytes carry the key index (little endian).
+    QByteArray encryptPackage(const QByteArray &data);
+    QByteArray decryptPackage(const QByteArray &package);
+
+    // Key ratchet: once ready, the send key will be replaced by a key derived from the previous
+    // one after the given amount of messages or bytes. A limit of 0 disables the limit.
+    // The receive key follows the key index of the received packages.
+    int rekeyMessageLimit() const;
+    qint64 rekeyByteLimit() const;
+    void setRekeyLimits(int messageLimit, qint64 byteLimit);
+
+    bool rekeyingEnabled() const;
+    void setRekeyingEnabled(bool rekeyingEnabled);
+
+    quint32 sendKeyIndex() const;
+    quint32 receiveKeyIndex() const;
+
 private:
     bool m_ready = false;
     bool m_initialized = false;
 
+    int m_rekeyMessageLimit = 0;
+    qint64 m_rekeyByteLimit = 0;
+    bool m_rekeyingEnabled = false;
+
     QByteArray m_privateKey;
     QByteArray m_publicKey;
     QByteArray m_sharedKey;
@@ -68,7 +90,22 @@ private:
     QByteArray m_challenge;
     QByteArray m_challengeConfirmation;
 
+    // Session keys for each direction, starting with the shared key
+    QByteArray m_sendKey;
+    quint32 m_sendKeyIndex = 0;
+    int m_sendMessageCount = 0;
+    qint64 m_sendByteCount = 0;
+
+    QByteArray m_receiveKey;
+    quint32 m_receiveKeyIndex = 0;
+
     void setReady(bool ready);
+    void resetSessionKeys();
+
+    QByteArray decryptData(const QByteArray &data, const QByteArray &nonce, const QByteArray &key);
+
+    QByteArray deriveNextKey(const QByteArray &key, quint32 keyIndex);
+    void updateSendKey(int dataLength);
 
 signals:
     void readyChanged(bool ready);
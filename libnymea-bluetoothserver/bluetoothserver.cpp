@@ -35,20 +35,43 @@
 #include <networkmanagerutils.h>
 
 #include <QFile>
+#include <QDataStream>
 #include <QSysInfo>
 
 
 BluetoothServer::BluetoothServer(QObject *parent) :
     QObject(parent)
 {
-    m_encryptionHandler = new EncryptionHandler(this);
+    m_encryptionService = new EncryptionService(this);
+    registerService(m_encryptionService);
 
-    // Debug
-    m_encryptionHandler->generateKeyPair();
-    qCDebug(dcNymeaBluetoothServer()) << "Nonce:" << m_encryptionHandler->generateNonce().toHex();
+    m_startupTimeoutTimer.setSingleShot(true);
+    connect(&m_startupTimeoutTimer, &QTimer::timeout, this, &BluetoothServer::onStartupTimeout);
 
-    m_encryptionService = new EncryptionService(m_encryptionHandler, this);
-    registerService(m_encryptionService);
+    m_startupRetryTimer.setSingleShot(true);
+    connect(&m_startupRetryTimer, &QTimer::timeout, this, &BluetoothServer::onStartupRetry);
+
+    m_restartTimer.setSingleShot(true);
+    connect(&m_restartTimer, &QTimer::timeout, this, &BluetoothServer::start);
+
+    m_sessionIdleTimer.setSingleShot(true);
+    connect(&m_sessionIdleTimer, &QTimer::timeout, this, &BluetoothServer::onSessionIdleTimeout);
+
+    m_linkSecurityProvider = new HciLinkSecurityProvider(this);
+
+    m_connectionParameterPolicy = new ConnectionParameterPolicy(this);
+    connect(m_connectionParameterPolicy, &ConnectionParameterPolicy::connectionUpdateRequested, this, &BluetoothServer::onConnectionUpdateRequested);
+
+    m_statusUpdateTimer.setSingleShot(true);
+    connect(&m_statusUpdateTimer, &QTimer::timeout, this, &BluetoothServer::updateAdvertisedStatus);
+
+    m_sessionBusyTimer.setSingleShot(true);
+    connect(&m_sessionBusyTimer, &QTimer::timeout, this, &BluetoothServer::updateAdvertisedStatus);
+
+    m_advertisingModeTimer.setSingleShot(true);
+    connect(&m_advertisingModeTimer, &QTimer::timeout, this, [this](){
+        setAdvertisingMode(AdvertisingModeSlow);
+    });
 }
 
 BluetoothServer::~BluetoothServer()
@@ -71,6 +94,7 @@ void BluetoothServer::setAdvertiseName(const QString &advertiseName)
 {
     Q_ASSERT_X(!m_running, "BluetoothServer", "set advertise name while server running is not allowed.");
     m_advertiseName = advertiseName;
+    m_genericAccessServiceData = QLowEnergyServiceData();
 }
 
 QString BluetoothServer::modelName() const
@@ -82,6 +106,7 @@ void BluetoothServer::setModelName(const QString &modelName)
 {
     Q_ASSERT_X(!m_running, "BluetoothServer", "set model name while server running is not allowed.");
     m_modelName = modelName;
+    m_deviceInfoServiceData = QLowEnergyServiceData();
 }
 
 QString BluetoothServer::softwareVersion() const
@@ -93,6 +118,7 @@ void BluetoothServer::setSoftwareVersion(const QString &softwareVersion)
 {
     Q_ASSERT_X(!m_running, "BluetoothServer", "set software version while server running is not allowed.");
     m_softwareVersion = softwareVersion;
+    m_deviceInfoServiceData = QLowEnergyServiceData();
 }
 
 QString BluetoothServer::hardwareVersion() const
@@ -104,6 +130,7 @@ void BluetoothServer::setHardwareVersion(const QString &hardwareVersion)
 {
     Q_ASSERT_X(!m_running, "BluetoothServer", "set hardware version while server running is not allowed.");
     m_hardwareVersion = hardwareVersion;
+    m_deviceInfoServiceData = QLowEnergyServiceData();
 }
 
 QString BluetoothServer::serialNumber() const
@@ -115,6 +142,162 @@ void BluetoothServer::setSerialNumber(const QString &serialNumber)
 {
     Q_ASSERT_X(!m_running, "BluetoothServer", "set serial number while server running is not allowed.");
     m_serialNumber = serialNumber;
+    m_deviceInfoServiceData = QLowEnergyServiceData();
+}
+
+bool BluetoothServer::warmRestartEnabled() const
+{
+    return m_warmRestartEnabled;
+}
+
+void BluetoothServer::setWarmRestartEnabled(bool warmRestartEnabled)
+{
+    m_warmRestartEnabled = warmRestartEnabled;
+}
+
+qint64 BluetoothServer::readvertiseDuration() const
+{
+    return m_readvertiseDuration;
+}
+
+qint64 BluetoothServer::startupDuration() const
+{
+    return m_startupDuration;
+}
+
+int BluetoothServer::rekeyMessageLimit() const
+{
+    return m_rekeyMessageLimit;
+}
+
+qint64 BluetoothServer::rekeyByteLimit() const
+{
+    return m_rekeyByteLimit;
+}
+
+void BluetoothServer::setRekeyLimits(int messageLimit, qint64 byteLimit)
+{
+    // Note: will be applied to the session of the next connection
+    m_rekeyMessageLimit = messageLimit;
+    m_rekeyByteLimit = byteLimit;
+}
+
+BluetoothSession *BluetoothServer::session() const
+{
+    return m_session;
+}
+
+int BluetoothServer::sessionIdleTimeout() const
+{
+    return m_sessionIdleTimeout;
+}
+
+void BluetoothServer::setSessionIdleTimeout(int sessionIdleTimeout)
+{
+    m_sessionIdleTimeout = qMax(0, sessionIdleTimeout);
+    onSessionIdleTimeout();
+}
+
+QList<BluetoothServer::SessionRecord> BluetoothServer::sessionHistory() const
+{
+    return m_sessionHistory;
+}
+
+QMap<BluetoothServer::SessionCloseReason, int> BluetoothServer::sessionCloseReasonCounts() const
+{
+    return m_sessionCloseReasonCounts;
+}
+
+BluetoothServer::StartupPhase BluetoothServer::startupPhase() const
+{
+    return m_startupPhase;
+}
+
+QMap<BluetoothServer::StartupPhase, qint64> BluetoothServer::startupPhaseDurations() const
+{
+    return m_startupPhaseDurations;
+}
+
+int BluetoothServer::restartDelay() const
+{
+    return m_restartDelay;
+}
+
+void BluetoothServer::setRestartDelay(int restartDelay)
+{
+    m_restartDelay = qMax(0, restartDelay);
+}
+
+int BluetoothServer::fastAdvertisingInterval() const
+{
+    return m_fastAdvertisingInterval;
+}
+
+int BluetoothServer::fastAdvertisingDuration() const
+{
+    return m_fastAdvertisingDuration;
+}
+
+int BluetoothServer::slowAdvertisingInterval() const
+{
+    return m_slowAdvertisingInterval;
+}
+
+void BluetoothServer::setAdvertisingSchedule(int fastInterval, int fastDuration, int slowInterval)
+{
+    Q_ASSERT_X(!m_running, "BluetoothServer", "set advertising schedule while server running is not allowed.");
+    m_fastAdvertisingInterval = fastInterval;
+    m_fastAdvertisingDuration = fastDuration;
+    m_slowAdvertisingInterval = slowInterval;
+}
+
+BluetoothServer::AdvertisingMode BluetoothServer::advertisingMode() const
+{
+    return m_advertisingMode;
+}
+
+QMap<BluetoothServer::AdvertisingMode, qint64> BluetoothServer::advertisingModeDurations() const
+{
+    QMap<AdvertisingMode, qint64> advertisingModeDurations = m_advertisingModeDurations;
+    if (m_advertisingTimer.isValid())
+        advertisingModeDurations[m_advertisingMode] += m_advertisingTimer.elapsed();
+
+    return advertisingModeDurations;
+}
+
+quint16 BluetoothServer::manufacturerId() const
+{
+    return m_manufacturerId;
+}
+
+void BluetoothServer::setManufacturerId(quint16 manufacturerId)
+{
+    Q_ASSERT_X(!m_running, "BluetoothServer", "set manufacturer id while server running is not allowed.");
+    m_manufacturerId = manufacturerId;
+}
+
+quint16 BluetoothServer::configurationGeneration() const
+{
+    return static_cast<quint16>(m_configurationGeneration + m_databaseVersion);
+}
+
+void BluetoothServer::setConfigurationGeneration(quint16 configurationGeneration)
+{
+    m_configurationGeneration = configurationGeneration;
+    updateAdvertisedStatus();
+}
+
+int BluetoothServer::connectionCount() const
+{
+    return m_connectionCount;
+}
+
+qint64 BluetoothServer::connectedDuration() const
+{
+    if (m_connectedTimer.isValid())
+        return m_connectedDuration + m_connectedTimer.elapsed();
+
+    return m_connectedDuration;
 }
 
 bool BluetoothServer::running() const
@@ -129,8 +312,45 @@ bool BluetoothServer::connected() const
 
 void BluetoothServer::registerService(BluetoothService *service)
 {
-    Q_ASSERT_X(!m_running, "BluetoothServer", "register service while server running is not allowed.");
+    if (m_registeredServices.contains(service)) {
+        qCWarning(dcNymeaBluetoothServer()) << "Service" << service->name() << "has already been registered.";
+        return;
+    }
+
     m_registeredServices.append(service);
+    updateServices();
+}
+
+void BluetoothServer::unregisterService(BluetoothService *service)
+{
+    if (service == m_encryptionService) {
+        qCWarning(dcNymeaBluetoothServer()) << "The encryption service can not be unregistered.";
+        return;
+    }
+
+    if (!m_registeredServices.removeOne(service))
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Unregister service" << service->name() << service->serviceUuid().toString();
+    m_registeredServiceData.remove(service);
+    service->setSession(nullptr);
+
+    // Note: while a client is connected the service stays in the GATT database until the
+    // client disconnects, but no data will be forwarded to the service any more. A response
+    // might still be in flight, so the objects will be deleted on the next rebuild.
+    BluetoothServiceDataHandler *dataHandler = findDataHandler(service);
+    if (dataHandler) {
+        m_dataHandlers.removeOne(dataHandler);
+        disconnect(service, nullptr, dataHandler, nullptr);
+        dataHandler->setSession(nullptr);
+        if (dataHandler->service())
+            m_unregisteredServices.append(dataHandler->service());
+
+        dataHandler->setService(nullptr);
+        dataHandler->deleteLater();
+    }
+
+    updateServices();
 }
 
 void BluetoothServer::registerNetworkManagerService(NetworkManager *networkManager)
@@ -140,19 +360,75 @@ void BluetoothServer::registerNetworkManagerService(NetworkManager *networkManag
 
     // Add deprecated services for remaining backwards compatible
     m_networkManager = networkManager;
-    registerService(new NetworkManagerService(m_networkManager, this));
+    connect(m_networkManager, &NetworkManager::stateChanged, this, &BluetoothServer::onNetworkManagerStateChanged);
+    if (m_networkManager->wirelessAvailable()) {
+        connect(m_networkManager->wirelessNetworkDevices().first(), &WirelessNetworkDevice::wirelessModeChanged, this, &BluetoothServer::updateAdvertisedStatus);
+    }
+    m_wirelessScanManager = new WirelessScanManager(m_networkManager, this);
+    m_interfaceAddressCache = new InterfaceAddressCache(this);
+    registerService(new NetworkManagerService(m_networkManager, m_wirelessScanManager, m_interfaceAddressCache, this));
+}
+
+WirelessScanManager *BluetoothServer::wirelessScanManager() const
+{
+    return m_wirelessScanManager;
+}
+
+int BluetoothServer::notificationInterval() const
+{
+    return m_notificationInterval;
+}
+
+void BluetoothServer::setNotificationInterval(int notificationInterval)
+{
+    m_notificationInterval = qMax(0, notificationInterval);
+    if (m_networkService)
+        m_networkService->notifier()->setMinimumInterval(m_notificationInterval);
+
+    if (m_wirelessService)
+        m_wirelessService->notifier()->setMinimumInterval(m_notificationInterval);
+}
+
+ConnectionParameterPolicy *BluetoothServer::connectionParameterPolicy() const
+{
+    return m_connectionParameterPolicy;
+}
+
+LinkSecurityProvider *BluetoothServer::linkSecurityProvider() const
+{
+    return m_linkSecurityProvider;
+}
+
+void BluetoothServer::setLinkSecurityProvider(LinkSecurityProvider *linkSecurityProvider)
+{
+    Q_ASSERT_X(!m_running, "BluetoothServer", "set link security provider while server running is not allowed.");
+    m_linkSecurityProvider = linkSecurityProvider;
 }
 
 void BluetoothServer::registerDeprecatedServices()
 {
+    // Note: the service data contains the current states, so they will be created again on each restart
+    if (m_networkService) {
+        delete m_networkService->service();
+        delete m_networkService;
+        m_networkService = nullptr;
+    }
+
+    if (m_wirelessService) {
+        delete m_wirelessService->service();
+        delete m_wirelessService;
+        m_wirelessService = nullptr;
+    }
+
     if (m_networkManager) {
         m_networkService = new NetworkService(m_controller->addService(NetworkService::serviceData(m_networkManager), m_controller),
                                               m_networkManager, m_controller);
-        m_serviceUuids.append(m_networkService->service()->serviceUuid());
 
         m_wirelessService = new WirelessService(m_controller->addService(WirelessService::serviceData(m_networkManager), m_controller),
-                                                m_networkManager, m_controller);
-        m_serviceUuids.append(m_wirelessService->service()->serviceUuid());
+                                                m_networkManager, m_wirelessScanManager, m_interfaceAddressCache, m_controller);
+
+        m_networkService->notifier()->setMinimumInterval(m_notificationInterval);
+        m_wirelessService->notifier()->setMinimumInterval(m_notificationInterval);
     }
 }
 
@@ -267,12 +543,535 @@ QLowEnergyServiceData BluetoothServer::genericAttributeServiceData()
     QLowEnergyCharacteristicData charData;
     charData.setUuid(QBluetoothUuid::ServiceChanged);
     charData.setProperties(QLowEnergyCharacteristic::Indicate);
+    charData.addDescriptor(QLowEnergyDescriptorData(QBluetoothUuid::ClientCharacteristicConfiguration, QByteArray(2, 0)));
 
     serviceData.addCharacteristic(charData);
 
     return serviceData;
 }
 
+void BluetoothServer::buildServiceData()
+{
+    // Note: the service data will be built only once and cached over restarts,
+    // the setters invalidate the service data containing the changed value.
+
+    // Default services: https://www.bluetooth.com/specifications/gatt/services
+    if (!m_deviceInfoServiceData.isValid())
+        m_deviceInfoServiceData = deviceInformationServiceData();
+
+    if (!m_genericAccessServiceData.isValid())
+        m_genericAccessServiceData = genericAccessServiceData();
+
+    if (!m_genericAttributeServiceData.isValid())
+        m_genericAttributeServiceData = genericAttributeServiceData();
+
+    // Registered generic services
+    foreach (BluetoothService *bluetoothService, m_registeredServices) {
+        if (m_registeredServiceData.contains(bluetoothService))
+            continue;
+
+        qCDebug(dcNymeaBluetoothServer()) << "Building service data for" << bluetoothService->name();
+        QLowEnergyServiceData serviceData;
+        serviceData.setType(QLowEnergyServiceData::ServiceTypePrimary);
+        serviceData.setUuid(bluetoothService->serviceUuid());
+
+        // Receiver characteristic
+        QLowEnergyCharacteristicData receiverCharacteristicData;
+        receiverCharacteristicData.setUuid(bluetoothService->receiverCharacteristicUuid());
+        receiverCharacteristicData.setProperties(QLowEnergyCharacteristic::Write);
+        receiverCharacteristicData.setValueLength(1, 20);
+
+        serviceData.addCharacteristic(receiverCharacteristicData);
+
+        // Sender characteristic
+        QLowEnergyCharacteristicData senderCharacteristicData;
+        senderCharacteristicData.setUuid(bluetoothService->senderCharacteristicUuid());
+        senderCharacteristicData.setProperties(QLowEnergyCharacteristic::Notify);
+        QLowEnergyDescriptorData senderClientConfigDescriptorData(QBluetoothUuid::ClientCharacteristicConfiguration, QByteArray(2, 0));
+        senderCharacteristicData.addDescriptor(senderClientConfigDescriptorData);
+        senderCharacteristicData.setValueLength(1, 20);
+        serviceData.addCharacteristic(senderCharacteristicData);
+
+        m_registeredServiceData.insert(bluetoothService, serviceData);
+    }
+}
+
+void BluetoothServer::addServices()
+{
+    // Services registered or changed since the service data has been built, i.e. while a client was connected
+    buildServiceData();
+
+    // The services of unregistered services are not part of the new database any more
+    foreach (const QPointer<QLowEnergyService> &service, m_unregisteredServices) {
+        if (!service.isNull()) {
+            service->deleteLater();
+        }
+    }
+    m_unregisteredServices.clear();
+
+    // Note: the controller invalidates all services once the client disconnected. The service
+    // objects will be replaced, the data handlers and the service data will be reused.
+    delete m_deviceInfoService;
+    m_deviceInfoService = m_controller->addService(m_deviceInfoServiceData, m_controller);
+    delete m_genericAccessService;
+    m_genericAccessService = m_controller->addService(m_genericAccessServiceData, m_controller);
+    delete m_genericAttributeService;
+    m_genericAttributeService = m_controller->addService(m_genericAttributeServiceData, m_controller);
+
+    // Add all registered generic services
+    foreach (BluetoothService *bluetoothService, m_registeredServices) {
+        QLowEnergyService *service = m_controller->addService(m_registeredServiceData.value(bluetoothService), m_controller);
+        BluetoothServiceDataHandler *dataHandler = findDataHandler(bluetoothService);
+        if (dataHandler) {
+            QLowEnergyService *invalidService = dataHandler->service();
+            dataHandler->setService(service);
+            delete invalidService;
+        } else {
+            qCDebug(dcNymeaBluetoothServer()) << "Register service" << bluetoothService->name() << bluetoothService->serviceUuid().toString();
+            // Create the generic service handler, taking care about the encryption, SLIP packaging for receiving and sending.
+            // Will be deleted with the controller on stop
+            m_dataHandlers.append(new BluetoothServiceDataHandler(service, bluetoothService, m_controller));
+        }
+    }
+
+    // Add deprecated services for backwards compatibility
+    registerDeprecatedServices();
+}
+
+void BluetoothServer::updateServices()
+{
+    m_databaseVersion++;
+
+    // Note: the service data will be built on start
+    if (!m_controller)
+        return;
+
+    if (m_controller->state() != QLowEnergyController::UnconnectedState && m_controller->state() != QLowEnergyController::AdvertisingState) {
+        qCDebug(dcNymeaBluetoothServer()) << "Services changed. The GATT database will be updated once the client disconnected.";
+        return;
+    }
+
+    // Note: services can only be added to a controller which is not advertising and there is no way
+    // to remove a single service, so the controller will be created again using the updated services.
+    qCDebug(dcNymeaBluetoothServer()) << "Services changed. Updating the GATT database.";
+    releaseController();
+    startController();
+}
+
+void BluetoothServer::indicateServiceChanged(const QBluetoothAddress &remoteAddress)
+{
+    // Note: only bonded clients may cache the database. Bonded clients connect using their identity
+    // address, random resolvable addresses of other clients would only fill up the map.
+    if (!m_localDevice || m_localDevice->pairingStatus(remoteAddress) == QBluetoothLocalDevice::Unpaired) {
+        m_clientDatabaseVersions.remove(remoteAddress);
+        return;
+    }
+
+    quint32 clientDatabaseVersion = m_clientDatabaseVersions.value(remoteAddress, m_databaseVersion);
+    m_clientDatabaseVersions.insert(remoteAddress, m_databaseVersion);
+    pruneClientDatabaseVersions();
+    if (clientDatabaseVersion == m_databaseVersion || !m_genericAttributeService)
+        return;
+
+    QLowEnergyCharacteristic serviceChangedCharacteristic = m_genericAttributeService->characteristic(QBluetoothUuid::ServiceChanged);
+    if (!serviceChangedCharacteristic.isValid())
+        return;
+
+    // Note: the default services are always added first and never change, so the affected range
+    // starts at the first registered service and ends with the last service added to the database.
+    QList<QLowEnergyService *> services;
+    foreach (BluetoothServiceDataHandler *dataHandler, m_dataHandlers) {
+        services.append(dataHandler->service());
+    }
+
+    if (m_networkService)
+        services.append(m_networkService->service());
+
+    if (m_wirelessService)
+        services.append(m_wirelessService->service());
+
+    quint16 startHandle = 0;
+    quint16 endHandle = 0;
+    foreach (QLowEnergyService *service, services) {
+        quint16 serviceStartHandle = 0;
+        quint16 serviceEndHandle = 0;
+        if (!serviceHandleRange(service, serviceStartHandle, serviceEndHandle))
+            continue;
+
+        if (startHandle == 0 || serviceStartHandle < startHandle)
+            startHandle = serviceStartHandle;
+
+        endHandle = qMax(endHandle, serviceEndHandle);
+    }
+
+    if (startHandle == 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not determine the handle range of the changed services.";
+        return;
+    }
+
+    qCDebug(dcNymeaBluetoothServer()) << "Services changed since the last connection of" << remoteAddress.toString() << "Indicate service changed for handle range" << startHandle << "-" << endHandle;
+
+    QByteArray value;
+    QDataStream stream(&value, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << startHandle << endHandle;
+    m_genericAttributeService->writeCharacteristic(serviceChangedCharacteristic, value);
+}
+
+bool BluetoothServer::serviceHandleRange(QLowEnergyService *service, quint16 &startHandle, quint16 &endHandle)
+{
+    if (!service || service->characteristics().isEmpty())
+        return false;
+
+    // Qt does not expose the handles of a service: the service declaration is followed by the
+    // declaration of the first characteristic, which is followed by its value.
+    startHandle = 0xffff;
+    endHandle = 0;
+    foreach (const QLowEnergyCharacteristic &characteristic, service->characteristics()) {
+        startHandle = qMin(startHandle, static_cast<quint16>(characteristic.handle() - 2));
+        endHandle = qMax(endHandle, static_cast<quint16>(characteristic.handle()));
+        foreach (const QLowEnergyDescriptor &descriptor, characteristic.descriptors()) {
+            endHandle = qMax(endHandle, static_cast<quint16>(descriptor.handle()));
+        }
+    }
+
+    return true;
+}
+
+void BluetoothServer::pruneClientDatabaseVersions()
+{
+    // Forget clients which are not bonded any more, then the ones with the oldest database
+    foreach (const QBluetoothAddress &address, m_clientDatabaseVersions.keys()) {
+        if (m_localDevice && m_localDevice->pairingStatus(address) == QBluetoothLocalDevice::Unpaired) {
+            m_clientDatabaseVersions.remove(address);
+        }
+    }
+
+    while (m_clientDatabaseVersions.count() > m_clientDatabaseVersionsLimit) {
+        QMap<QBluetoothAddress, quint32>::iterator oldest = m_clientDatabaseVersions.begin();
+        for (QMap<QBluetoothAddress, quint32>::iterator it = m_clientDatabaseVersions.begin(); it != m_clientDatabaseVersions.end(); ++it) {
+            if (it.value() < oldest.value()) {
+                oldest = it;
+            }
+        }
+        m_clientDatabaseVersions.erase(oldest);
+    }
+}
+
+BluetoothServiceDataHandler *BluetoothServer::findDataHandler(BluetoothService *bluetoothService) const
+{
+    foreach (BluetoothServiceDataHandler *dataHandler, m_dataHandlers) {
+        if (dataHandler->bluetoothService() == bluetoothService) {
+            return dataHandler;
+        }
+    }
+
+    return nullptr;
+}
+
+void BluetoothServer::startAdvertising()
+{
+    QLowEnergyAdvertisingData advertisingData;
+    advertisingData.setDiscoverability(QLowEnergyAdvertisingData::DiscoverabilityGeneral);
+    advertisingData.setIncludePowerLevel(true);
+    advertisingData.setLocalName(m_advertiseName);
+    advertisingData.setServices({m_encryptionService->serviceUuid()});
+
+    // Note: the advertising data is full, the status will be sent in the scan response. The name is already
+    // part of the advertising data, a long name would exceed the 31 bytes of the scan response.
+    m_advertisedStatus = statusData();
+    QLowEnergyAdvertisingData scanResponseData;
+    scanResponseData.setManufacturerData(m_manufacturerId, m_advertisedStatus);
+
+    // Note: the fast interval makes the device better discoverable on certain client devices
+    int interval = m_advertisingMode == AdvertisingModeFast ? m_fastAdvertisingInterval : m_slowAdvertisingInterval;
+    QLowEnergyAdvertisingParameters advertisingParameters;
+    advertisingParameters.setInterval(interval, interval);
+
+    qCDebug(dcNymeaBluetoothServer()) << "Start advertising" << m_advertiseName << m_localDevice->address().toString() << m_advertisingMode << interval << "ms";
+    m_controller->startAdvertising(advertisingParameters, advertisingData, scanResponseData);
+    m_statusUpdateElapsedTimer.start();
+}
+
+QByteArray BluetoothServer::statusData() const
+{
+    NetworkManager::NetworkManagerState networkManagerState = NetworkManager::NetworkManagerStateUnknown;
+    WirelessNetworkDevice::WirelessMode wirelessMode = WirelessNetworkDevice::WirelessModeUnknown;
+    if (m_networkManager) {
+        networkManagerState = m_networkManager->state();
+        if (m_networkManager->wirelessAvailable()) {
+            wirelessMode = m_networkManager->wirelessNetworkDevices().first()->wirelessMode();
+        }
+    }
+
+    // Note: the controller stops advertising while a client is connected, the busy flag
+    // tells other clients that a client has been connected right before.
+    quint8 flags = 0;
+    if (m_session || m_sessionBusyTimer.isActive())
+        flags |= 0x01;
+
+    QByteArray status;
+    status.append(static_cast<char>(0x01)); // Version
+    status.append(NetworkService::getNetworkManagerStateByteArray(networkManagerState));
+    status.append(WirelessService::getWirelessMode(wirelessMode));
+    status.append(static_cast<char>(flags));
+    quint16 generation = configurationGeneration();
+    status.append(static_cast<char>(generation & 0xff));
+    status.append(static_cast<char>((generation >> 8) & 0xff));
+    return status;
+}
+
+void BluetoothServer::updateAdvertisedStatus()
+{
+    // Note: the current status will be used once advertising starts again
+    if (!m_controller || m_controller->state() != QLowEnergyController::AdvertisingState)
+        return;
+
+    if (m_statusUpdateTimer.isActive() || statusData() == m_advertisedStatus)
+        return;
+
+    // Limit the updates, each update starts advertising again
+    qint64 elapsed = m_statusUpdateElapsedTimer.isValid() ? m_statusUpdateElapsedTimer.elapsed() : m_statusUpdateInterval;
+    if (elapsed < m_statusUpdateInterval) {
+        m_statusUpdateTimer.start(static_cast<int>(m_statusUpdateInterval - elapsed));
+        return;
+    }
+
+    qCDebug(dcNymeaBluetoothServer()) << "Advertised status changed" << statusData().toHex();
+    m_controller->stopAdvertising();
+    startAdvertising();
+}
+
+void BluetoothServer::setAdvertisingMode(AdvertisingMode advertisingMode)
+{
+    if (advertisingMode == AdvertisingModeFast && m_fastAdvertisingDuration > 0) {
+        m_advertisingModeTimer.start(m_fastAdvertisingDuration);
+    } else {
+        m_advertisingModeTimer.stop();
+    }
+
+    if (m_advertisingMode == advertisingMode)
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Advertising mode changed to" << advertisingMode;
+
+    // Note: the interval can only be changed by starting to advertise again
+    bool advertising = m_controller && m_controller->state() == QLowEnergyController::AdvertisingState;
+    if (advertising)
+        m_controller->stopAdvertising();
+
+    m_advertisingMode = advertisingMode;
+
+    if (advertising)
+        startAdvertising();
+}
+
+void BluetoothServer::updateAdvertisingTime()
+{
+    if (!m_advertisingTimer.isValid())
+        return;
+
+    m_advertisingModeDurations[m_advertisingMode] += m_advertisingTimer.elapsed();
+    m_advertisingTimer.invalidate();
+}
+
+BluetoothSession *BluetoothServer::openSession(const QBluetoothAddress &remoteAddress)
+{
+    BluetoothSession *session = new BluetoothSession(remoteAddress, this);
+    session->encryptionHandler()->setRekeyLimits(m_rekeyMessageLimit, m_rekeyByteLimit);
+    session->setLinkSecurityProvider(m_linkSecurityProvider);
+    m_session = session;
+    connect(session, &BluetoothSession::activity, m_connectionParameterPolicy, &ConnectionParameterPolicy::notifyActivity);
+    qCDebug(dcNymeaBluetoothServer()) << "Session opened for" << remoteAddress.toString();
+    onSessionIdleTimeout();
+
+    // Note: the peripheral controller serves exactly one connection, the session of that connection will be used by all services
+    foreach (BluetoothServiceDataHandler *dataHandler, m_dataHandlers) {
+        dataHandler->setSession(session);
+    }
+
+    foreach (BluetoothService *bluetoothService, m_registeredServices) {
+        bluetoothService->setSession(session);
+    }
+
+    if (m_networkService)
+        m_networkService->setSession(session);
+
+    if (m_wirelessService)
+        m_wirelessService->setSession(session);
+
+    return session;
+}
+
+void BluetoothServer::closeSession(SessionCloseReason closeReason)
+{
+    m_sessionIdleTimer.stop();
+    if (!m_session)
+        return;
+
+    BluetoothSession *session = m_session;
+    m_session = nullptr;
+
+    SessionRecord record;
+    record.remoteAddress = session->remoteAddress();
+    record.closeReason = closeReason;
+    record.duration = session->duration();
+    record.bytesReceived = session->bytesReceived();
+    record.bytesSent = session->bytesSent();
+    m_sessionHistory.append(record);
+    while (m_sessionHistory.count() > m_sessionHistoryLimit)
+        m_sessionHistory.removeFirst();
+
+    m_sessionCloseReasonCounts[closeReason]++;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Session closed for" << record.remoteAddress.toString() << closeReason << "after" << record.duration << "ms. Received" << record.bytesReceived << "bytes, sent" << record.bytesSent << "bytes.";
+    foreach (BluetoothServiceDataHandler *dataHandler, m_dataHandlers) {
+        dataHandler->setSession(nullptr);
+    }
+
+    foreach (BluetoothService *bluetoothService, m_registeredServices) {
+        bluetoothService->setSession(nullptr);
+    }
+
+    if (m_networkService)
+        m_networkService->setSession(nullptr);
+
+    if (m_wirelessService)
+        m_wirelessService->setSession(nullptr);
+
+    // Note: the session might still be in use further up the call stack
+    session->deleteLater();
+}
+
+void BluetoothServer::warmRestart()
+{
+    qCDebug(dcNymeaBluetoothServer()) << "Warm restart of the bluetooth server. Keeping the controller and services.";
+    m_readvertiseTimer.start();
+    addServices();
+    setAdvertisingMode(AdvertisingModeFast);
+    startAdvertising();
+}
+
+void BluetoothServer::startAdapter()
+{
+    setStartupPhase(StartupPhasePoweringOn);
+
+    // Local bluetooth device
+    // Note: the Qt 5 peripheral controller will always be created on the default adapter
+    m_localDevice = new QBluetoothLocalDevice(this);
+
+    if (!m_localDevice->isValid()) {
+        qCWarning(dcNymeaBluetoothServer()) << "Local bluetooth device is not valid.";
+        scheduleStartupRetry();
+        return;
+    }
+
+    connect(m_localDevice, &QBluetoothLocalDevice::hostModeStateChanged, this, &BluetoothServer::onHostModeStateChanged);
+    connect(m_localDevice, &QBluetoothLocalDevice::deviceConnected, this, &BluetoothServer::onDeviceConnected);
+    connect(m_localDevice, &QBluetoothLocalDevice::deviceDisconnected, this, &BluetoothServer::onDeviceDisconnected);
+
+    qCDebug(dcNymeaBluetoothServer()) << "Local device" << m_localDevice->name() << m_localDevice->address().toString();
+    m_localDevice->setHostMode(QBluetoothLocalDevice::HostDiscoverable);
+    m_localDevice->powerOn();
+
+    // Build the GATT database while the adapter is powering up
+    buildServiceData();
+
+    // Note: the host mode change might already have been handled
+    if (m_startupPhase != StartupPhasePoweringOn)
+        return;
+
+    if (m_localDevice->hostMode() != QBluetoothLocalDevice::HostPoweredOff) {
+        startController();
+        return;
+    }
+
+    // Continue once the adapter is powered, see onHostModeStateChanged()
+    qCDebug(dcNymeaBluetoothServer()) << "Waiting for the adapter to power on...";
+    m_startupTimeoutTimer.start(m_startupTimeout);
+}
+
+void BluetoothServer::startController()
+{
+    setStartupPhase(StartupPhaseStartingAdvertising);
+
+    // Bluetooth low energy periperal controller
+    m_controller = QLowEnergyController::createPeripheral(this);
+    connect(m_controller, &QLowEnergyController::stateChanged, this, &BluetoothServer::onControllerStateChanged);
+    connect(m_controller, &QLowEnergyController::connected, this, &BluetoothServer::onConnected);
+    connect(m_controller, &QLowEnergyController::disconnected, this, &BluetoothServer::onDisconnected);
+    connect(m_controller, &QLowEnergyController::connectionUpdated, this, &BluetoothServer::onConnectionUpdated);
+    connect(m_controller, SIGNAL(error(QLowEnergyController::Error)), this, SLOT(onError(QLowEnergyController::Error)));
+
+    // Add the GATT database to the controller, the service data has usually been prepared already
+    addServices();
+    setAdvertisingMode(AdvertisingModeFast);
+    startAdvertising();
+
+    // Continue once advertising, see onControllerStateChanged()
+    m_startupTimeoutTimer.start(m_startupTimeout);
+}
+
+void BluetoothServer::releaseAdapter()
+{
+    if (m_localDevice) {
+        qCDebug(dcNymeaBluetoothServer()) << "Set host mode to connectable.";
+        m_localDevice->setHostMode(QBluetoothLocalDevice::HostConnectable);
+        delete m_localDevice;
+        m_localDevice = nullptr;
+    }
+
+    releaseController();
+}
+
+void BluetoothServer::releaseController()
+{
+    if (m_controller) {
+        qCDebug(dcNymeaBluetoothServer()) << "Stop advertising.";
+        m_controller->stopAdvertising();
+        m_dataHandlers.clear();
+        m_unregisteredServices.clear();
+        m_deviceInfoService = nullptr;
+        m_genericAccessService = nullptr;
+        m_genericAttributeService = nullptr;
+        m_networkService = nullptr;
+        m_wirelessService = nullptr;
+        delete m_controller;
+        m_controller = nullptr;
+    }
+}
+
+void BluetoothServer::scheduleStartupRetry()
+{
+    // Note: the adapter will be released from the retry timer, this might be called from a signal of the controller
+    m_startupTimeoutTimer.stop();
+    setStartupPhase(StartupPhaseRetrying);
+    if (m_startupAttempt >= m_startupRetryLimit) {
+        qCWarning(dcNymeaBluetoothServer()) << "Failed to start the bluetooth server after" << m_startupAttempt + 1 << "attempts. Giving up.";
+        m_startupFailed = true;
+        m_startupRetryTimer.start(0);
+        return;
+    }
+
+    int delay = m_startupRetryDelay * (1 << m_startupAttempt);
+    m_startupAttempt++;
+    qCDebug(dcNymeaBluetoothServer()) << "Retry starting the bluetooth server in" << delay << "ms. Attempt" << m_startupAttempt << "of" << m_startupRetryLimit;
+    m_startupRetryTimer.start(delay);
+}
+
+void BluetoothServer::setStartupPhase(StartupPhase startupPhase)
+{
+    if (m_startupPhase == startupPhase)
+        return;
+
+    if (m_startupPhaseTimer.isValid() && m_startupPhase != StartupPhaseIdle && m_startupPhase != StartupPhaseAdvertising)
+        m_startupPhaseDurations[m_startupPhase] += m_startupPhaseTimer.elapsed();
+
+    qCDebug(dcNymeaBluetoothServer()) << "Startup phase" << startupPhase;
+    m_startupPhase = startupPhase;
+    m_startupPhaseTimer.start();
+}
+
 void BluetoothServer::setRunning(bool running)
 {
     if (m_running == running)
@@ -288,6 +1087,14 @@ void BluetoothServer::setConnected(bool connected)
         return;
 
     m_connected = connected;
+    if (m_connected) {
+        m_connectionCount++;
+        m_connectedTimer.start();
+    } else if (m_connectedTimer.isValid()) {
+        m_connectedDuration += m_connectedTimer.elapsed();
+        m_connectedTimer.invalidate();
+    }
+
     emit connectedChanged(m_connected);
 }
 
@@ -326,6 +1133,11 @@ void BluetoothServer::onHostModeStateChanged(const QBluetoothLocalDevice::HostMo
         qCDebug(dcNymeaBluetoothServer()) << "Bluetooth host in discoverable limited inquiry mode.";
         break;
     }
+
+    if (m_startupPhase == StartupPhasePoweringOn && mode != QBluetoothLocalDevice::HostPoweredOff) {
+        m_startupTimeoutTimer.stop();
+        startController();
+    }
 }
 
 void BluetoothServer::onDeviceConnected(const QBluetoothAddress &address)
@@ -341,23 +1153,88 @@ void BluetoothServer::onDeviceDisconnected(const QBluetoothAddress &address)
 void BluetoothServer::onError(QLowEnergyController::Error error)
 {
     qCWarning(dcNymeaBluetoothServer()) << "Bluetooth error occured:" << error << m_controller->errorString();
+    if (m_startupPhase == StartupPhaseStartingAdvertising) {
+        scheduleStartupRetry();
+    }
+}
+
+void BluetoothServer::onStartupTimeout()
+{
+    qCWarning(dcNymeaBluetoothServer()) << "Startup phase" << m_startupPhase << "timed out.";
+    scheduleStartupRetry();
+}
+
+void BluetoothServer::onStartupRetry()
+{
+    if (m_startupFailed) {
+        m_startupFailed = false;
+        stop();
+        emit startupFailed();
+        if (m_restartDelay > 0) {
+            qCDebug(dcNymeaBluetoothServer()) << "Starting the bluetooth server again in" << m_restartDelay << "ms";
+            m_restartTimer.start(m_restartDelay);
+        }
+        return;
+    }
+
+    releaseAdapter();
+    startAdapter();
+}
+
+void BluetoothServer::onSessionIdleTimeout()
+{
+    m_sessionIdleTimer.stop();
+    if (m_sessionIdleTimeout <= 0 || !m_session)
+        return;
+
+    // Wake up once the session could expire, activity will be checked then
+    qint64 remaining = m_sessionIdleTimeout - m_session->idleDuration();
+    if (remaining > 0) {
+        m_sessionIdleTimer.start(static_cast<int>(remaining));
+        return;
+    }
+
+    qCDebug(dcNymeaBluetoothServer()) << "Session of" << m_session->remoteAddress().toString() << "idle for" << m_session->idleDuration() << "ms. Disconnecting client.";
+    QBluetoothAddress remoteAddress = m_session->remoteAddress();
+    closeSession(SessionCloseReasonIdleTimeout);
+    if (m_controller && m_controller->state() == QLowEnergyController::ConnectedState && m_controller->remoteAddress() == remoteAddress) {
+        m_controller->disconnectFromDevice();
+    }
 }
 
 void BluetoothServer::onConnected()
 {
     qCDebug(dcNymeaBluetoothServer()) << "Client connected" << m_controller->remoteName() << m_controller->remoteAddress();
+    if (m_session) {
+        qCWarning(dcNymeaBluetoothServer()) << "Closing the session of a previous connection which did not disconnect properly.";
+        closeSession(SessionCloseReasonDisconnected);
+    }
+
+    BluetoothSession *session = openSession(m_controller->remoteAddress());
     setConnected(true);
+    m_connectionParameterPolicy->start();
+    indicateServiceChanged(session->remoteAddress());
 }
 
 void BluetoothServer::onDisconnected()
 {
     qCDebug(dcNymeaBluetoothServer()) << "Client disconnected";
+    m_connectionParameterPolicy->stop();
+    closeSession(SessionCloseReasonDisconnected);
     setConnected(false);
-    stop();
+    m_sessionBusyTimer.start(m_sessionBusyDuration);
+    if (m_warmRestartEnabled && m_running && m_controller && m_localDevice) {
+        warmRestart();
+    } else {
+        stop();
+    }
 }
 
 void BluetoothServer::onControllerStateChanged(QLowEnergyController::ControllerState state)
 {
+    // Count the time spent advertising in the current mode
+    updateAdvertisingTime();
+
     switch (state) {
     case QLowEnergyController::UnconnectedState:
         qCDebug(dcNymeaBluetoothServer()) << "Controller state disonnected.";
@@ -382,11 +1259,52 @@ void BluetoothServer::onControllerStateChanged(QLowEnergyController::ControllerS
         break;
     case QLowEnergyController::AdvertisingState:
         qCDebug(dcNymeaBluetoothServer()) << "Controller state advertising...";
+        if (m_startupPhase == StartupPhaseStartingAdvertising) {
+            m_startupTimeoutTimer.stop();
+            setStartupPhase(StartupPhaseAdvertising);
+        }
+
+        m_advertisingTimer.start();
+
+        if (m_startupTimer.isValid()) {
+            m_startupDuration = m_startupTimer.elapsed();
+            m_startupTimer.invalidate();
+            qCDebug(dcNymeaBluetoothServer()) << "Advertising" << m_startupDuration << "ms after start";
+        }
+
+        if (m_readvertiseTimer.isValid()) {
+            m_readvertiseDuration = m_readvertiseTimer.elapsed();
+            m_readvertiseTimer.invalidate();
+            qCDebug(dcNymeaBluetoothServer()) << "Advertising again" << m_readvertiseDuration << "ms after the client disconnected";
+        }
         setRunning(true);
         break;
     }
 }
 
+void BluetoothServer::onNetworkManagerStateChanged()
+{
+    // Make the device easier to find for clients while the network is down
+    if (m_networkManager->state() < NetworkManager::NetworkManagerStateConnectedGlobal) {
+        triggerFastAdvertising();
+    }
+
+    updateAdvertisedStatus();
+}
+
+void BluetoothServer::onConnectionUpdateRequested(const QLowEnergyConnectionParameters &parameters)
+{
+    if (!m_controller || m_controller->state() != QLowEnergyController::ConnectedState)
+        return;
+
+    m_controller->requestConnectionUpdate(parameters);
+}
+
+void BluetoothServer::onConnectionUpdated(const QLowEnergyConnectionParameters &parameters)
+{
+    qCDebug(dcNymeaBluetoothServer()) << "Connection parameters updated. Interval" << parameters.minimumInterval() << "ms, latency" << parameters.latency() << "supervision timeout" << parameters.supervisionTimeout() << "ms";
+}
+
 void BluetoothServer::characteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &value)
 {
     qCDebug(dcNymeaBluetoothServer()) << "Service characteristic changed" << characteristic.uuid() << value;
@@ -454,85 +1372,20 @@ void BluetoothServer::start()
         return;
     }
 
-    qCDebug(dcNymeaBluetoothServer()) << "-------------------------------------";
-    qCDebug(dcNymeaBluetoothServer()) << "Starting bluetooth server...";
-    qCDebug(dcNymeaBluetoothServer()) << "-------------------------------------";
-
-    // Local bluetooth device
-    m_localDevice = new QBluetoothLocalDevice(this);
-    if (!m_localDevice->isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "Local bluetooth device is not valid.";
-        delete m_localDevice;
-        m_localDevice = nullptr;
+    if (m_startupPhase != StartupPhaseIdle) {
+        qCDebug(dcNymeaBluetoothServer()) << "Start Bluetooth server called but the server is already starting. Doing nothing.";
         return;
     }
 
-    connect(m_localDevice, &QBluetoothLocalDevice::hostModeStateChanged, this, &BluetoothServer::onHostModeStateChanged);
-    connect(m_localDevice, &QBluetoothLocalDevice::deviceConnected, this, &BluetoothServer::onDeviceConnected);
-    connect(m_localDevice, &QBluetoothLocalDevice::deviceDisconnected, this, &BluetoothServer::onDeviceDisconnected);
-
-    qCDebug(dcNymeaBluetoothServer()) << "Local device" << m_localDevice->name() << m_localDevice->address().toString();
-    m_localDevice->setHostMode(QBluetoothLocalDevice::HostDiscoverable);
-    m_localDevice->powerOn();
-
-    // Bluetooth low energy periperal controller
-    m_controller = QLowEnergyController::createPeripheral(this);
-    connect(m_controller, &QLowEnergyController::stateChanged, this, &BluetoothServer::onControllerStateChanged);
-    connect(m_controller, &QLowEnergyController::connected, this, &BluetoothServer::onConnected);
-    connect(m_controller, &QLowEnergyController::disconnected, this, &BluetoothServer::onDisconnected);
-    connect(m_controller, SIGNAL(error(QLowEnergyController::Error)), this, SLOT(onError(QLowEnergyController::Error)));
-
-    // Add default services: https://www.bluetooth.com/specifications/gatt/services
-    m_deviceInfoService = m_controller->addService(deviceInformationServiceData(), m_controller);
-    m_serviceUuids.append(deviceInformationServiceData().uuid());
-    m_genericAccessService = m_controller->addService(genericAccessServiceData(), m_controller);
-    m_serviceUuids.append(genericAccessServiceData().uuid());
-    m_genericAttributeService = m_controller->addService(genericAttributeServiceData(), m_controller);
-    m_serviceUuids.append(genericAttributeServiceData().uuid());
-
-    // Add all registered generic services
-    foreach (BluetoothService *bluetoothService, m_registeredServices) {
-        qCDebug(dcNymeaBluetoothServer()) << "Register service" << bluetoothService->name() << bluetoothService->serviceUuid().toString();
-        QLowEnergyServiceData serviceData;
-        serviceData.setType(QLowEnergyServiceData::ServiceTypePrimary);
-        serviceData.setUuid(bluetoothService->serviceUuid());
-
-        QLowEnergyCharacteristicData receiverCharacteristicData;
-        receiverCharacteristicData.setUuid(bluetoothService->receiverCharacteristicUuid());
-        receiverCharacteristicData.setProperties(QLowEnergyCharacteristic::Write);
-        receiverCharacteristicData.setValueLength(1, 20);
-        serviceData.addCharacteristic(receiverCharacteristicData);
-
-        // Sender characteristic
-        QLowEnergyCharacteristicData senderCharacteristicData;
-        senderCharacteristicData.setUuid(bluetoothService->senderCharacteristicUuid());
-        senderCharacteristicData.setProperties(QLowEnergyCharacteristic::Notify);
-        senderCharacteristicData.addDescriptor(QLowEnergyDescriptorData(QBluetoothUuid::ClientCharacteristicConfiguration, QByteArray(2, 0)));
-        senderCharacteristicData.setValueLength(1, 20);
-        serviceData.addCharacteristic(senderCharacteristicData);
-
-        QLowEnergyService *service = m_controller->addService(serviceData, m_controller);
-        // Create the generic service handler, taking care about the encryption, SLIP packaging for receiving and sending.
-        // Will be deleted with the controller on stop
-        new BluetoothServiceDataHandler(m_encryptionHandler, service, bluetoothService, m_controller);
-    }
-
-    // Add deprecated services for backwards compatibility
-    registerDeprecatedServices();
-
-    QLowEnergyAdvertisingData advertisingData;
-    advertisingData.setDiscoverability(QLowEnergyAdvertisingData::DiscoverabilityGeneral);
-    advertisingData.setIncludePowerLevel(true);
-    advertisingData.setLocalName(m_advertiseName);
-    advertisingData.setServices({m_encryptionService->serviceUuid()});
-    // FIXME: set nymea manufacturer SIG data once available
-
-    // Note: advertise in 100 ms interval, this makes the device better discoverable on certain client devices
-    QLowEnergyAdvertisingParameters advertisingParameters;
-    advertisingParameters.setInterval(100, 100);
+    qCDebug(dcNymeaBluetoothServer()) << "-------------------------------------";
+    qCDebug(dcNymeaBluetoothServer()) << "Starting bluetooth server...";
+    qCDebug(dcNymeaBluetoothServer()) << "-------------------------------------";
+    m_restartTimer.stop();
+    m_startupTimer.start();
+    m_startupPhaseDurations.clear();
+    m_startupAttempt = 0;
 
-    qCDebug(dcNymeaBluetoothServer()) << "Start advertising" << m_advertiseName << m_localDevice->address().toString();
-    m_controller->startAdvertising(advertisingParameters, advertisingData, advertisingData);
+    startAdapter();
 
     // Note: setRunning(true) will be called when the service is really advertising, see onControllerStateChanged()
 }
@@ -543,20 +1396,31 @@ void BluetoothServer::stop()
     qCDebug(dcNymeaBluetoothServer()) << "Stopping bluetooth server.";
     qCDebug(dcNymeaBluetoothServer()) << "-------------------------------------";
 
-    if (m_localDevice) {
-        qCDebug(dcNymeaBluetoothServer()) << "Set host mode to connectable.";
-        m_localDevice->setHostMode(QBluetoothLocalDevice::HostConnectable);
-        delete m_localDevice;
-        m_localDevice = nullptr;
-    }
+    m_startupTimeoutTimer.stop();
+    m_startupRetryTimer.stop();
+    m_restartTimer.stop();
+    m_startupFailed = false;
+    m_startupTimer.invalidate();
+    setStartupPhase(StartupPhaseIdle);
 
-    if (m_controller) {
-        qCDebug(dcNymeaBluetoothServer()) << "Stop advertising.";
-        m_controller->stopAdvertising();
-        delete m_controller;
-        m_controller = nullptr;
-    }
+    m_advertisingModeTimer.stop();
+    m_statusUpdateTimer.stop();
+    m_sessionBusyTimer.stop();
+    updateAdvertisingTime();
+
+    releaseAdapter();
 
+    m_connectionParameterPolicy->stop();
+    closeSession(SessionCloseReasonStopped);
     setConnected(false);
     setRunning(false);
 }
+
+void BluetoothServer::triggerFastAdvertising()
+{
+    if (!m_running)
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Fast advertising triggered";
+    setAdvertisingMode(AdvertisingModeFast);
+}
@@ -31,10 +31,11 @@
 #ifndef BLUETOOTHSERVER_H
 #define BLUETOOTHSERVER_H
 
+#include <QMap>
 #include <QObject>
 #include <QTimer>
-#include <QObject>
 #include <QPointer>
+#include <QElapsedTimer>
 #include <QLowEnergyHandle>
 #include <QLowEnergyService>
 #include <QBluetoothLocalDevice>
@@ -49,12 +50,16 @@
 
 #include "bluetoothservice.h"
 #include "bluetoothservicedatahandler.h"
-#include "encryptionhandler.h"
+#include "bluetoothsession.h"
+#include "linksecurityprovider.h"
+#include "connectionparameterpolicy.h"
 
 #include "encryptionservice.h"
 #include "networkmanager/networkmanagerservice.h"
 #include "networkmanager/networkservice.h"
 #include "networkmanager/wirelessservice.h"
+#include "networkmanager/wirelessscanmanager.h"
+#include "networkmanager/interfaceaddresscache.h"
 
 class NetworkManager;
 
@@ -62,6 +67,38 @@ class BluetoothServer : public QObject
 {
     Q_OBJECT
 public:
+    enum StartupPhase {
+        StartupPhaseIdle,
+        StartupPhasePoweringOn,
+        StartupPhaseStartingAdvertising,
+        StartupPhaseRetrying,
+        StartupPhaseAdvertising
+    };
+    Q_ENUM(StartupPhase)
+
+    enum AdvertisingMode {
+        AdvertisingModeFast,
+        AdvertisingModeSlow
+    };
+    Q_ENUM(AdvertisingMode)
+
+    enum SessionCloseReason {
+        SessionCloseReasonDisconnected,
+        SessionCloseReasonIdleTimeout,
+        SessionCloseReasonStopped
+    };
+    Q_ENUM(SessionCloseReason)
+
+    class SessionRecord
+    {
+    public:
+        QBluetoothAddress remoteAddress;
+        SessionCloseReason closeReason = SessionCloseReasonDisconnected;
+        qint64 duration = 0; // ms
+        qint64 bytesReceived = 0;
+        qint64 bytesSent = 0;
+    };
+
     explicit BluetoothServer(QObject *parent = nullptr);
     ~BluetoothServer();
 
@@ -81,12 +118,92 @@ public:
     QString serialNumber() const;
     void setSerialNumber(const QString &serialNumber);
 
+    // Keep the controller and the services once the client disconnected and start advertising again right away
+    bool warmRestartEnabled() const;
+    void setWarmRestartEnabled(bool warmRestartEnabled);
+
+    // Time in ms from the last client disconnect until advertising again using the warm restart, -1 if not available
+    qint64 readvertiseDuration() const;
+
+    // Time in ms from the last start() until advertising, -1 if not available
+    qint64 startupDuration() const;
+
+    // Time in ms spent in each phase of the last start()
+    StartupPhase startupPhase() const;
+    QMap<StartupPhase, qint64> startupPhaseDurations() const;
+
+    // Start again after the given time in ms once the startup failed after all retries, 0 disables the restart
+    int restartDelay() const;
+    void setRestartDelay(int restartDelay);
+
+    // Session key ratchet for the encryption, 0 disables the limit
+    int rekeyMessageLimit() const;
+    qint64 rekeyByteLimit() const;
+    void setRekeyLimits(int messageLimit, qint64 byteLimit);
+
+    // The state of the connected client, nullptr if no client is connected. Note: the Qt peripheral
+    // controller serves one connection at a time and stops advertising while connected.
+    BluetoothSession *session() const;
+
+    // Disconnect a client which did not send any data for the given time in ms, 0 disables the timeout.
+    // Clients without regular traffic can keep the session alive using the heartbeat method of the encryption service.
+    int sessionIdleTimeout() const;
+    void setSessionIdleTimeout(int sessionIdleTimeout);
+
+    // The last closed sessions, the oldest first
+    QList<SessionRecord> sessionHistory() const;
+    QMap<SessionCloseReason, int> sessionCloseReasonCounts() const;
+
+    // Advertise with the fast interval for the given duration after start, disconnect or
+    // triggerFastAdvertising(), then with the slow interval. A duration of 0 always uses the fast interval.
+    int fastAdvertisingInterval() const; // ms
+    int fastAdvertisingDuration() const; // ms
+    int slowAdvertisingInterval() const; // ms
+    void setAdvertisingSchedule(int fastInterval, int fastDuration, int slowInterval);
+
+    // Time in ms spent advertising in each mode
+    AdvertisingMode advertisingMode() const;
+    QMap<AdvertisingMode, qint64> advertisingModeDurations() const;
+
+    // Status in the manufacturer specific data of the scan response. 0xffff is the id reserved for testing,
+    // since there is no company id assigned for nymea yet.
+    quint16 manufacturerId() const;
+    void setManufacturerId(quint16 manufacturerId);
+
+    // Will be advertised within the status. The advertised generation changes with each change of the GATT database,
+    // the application has to increment the generation set here whenever its own configuration changed.
+    quint16 configurationGeneration() const;
+    void setConfigurationGeneration(quint16 configurationGeneration);
+
+    // Utilisation since the server has been created
+    int connectionCount() const;
+    qint64 connectedDuration() const; // ms
+
     bool running() const;
     bool connected() const;
 
+    // Services can be registered and unregistered while running. Connected clients will see
+    // the change once reconnected and get a service changed indication if they subscribed it.
     void registerService(BluetoothService *service);
+    void unregisterService(BluetoothService *service);
     void registerNetworkManagerService(NetworkManager *networkManager);
 
+    // Shared by the network manager services, nullptr until registerNetworkManagerService() has been called
+    WirelessScanManager *wirelessScanManager() const;
+
+    // Minimum time in ms between two notifications of a status characteristic of the deprecated services,
+    // state changes in between will be conflated to the newest value.
+    int notificationInterval() const;
+    void setNotificationInterval(int notificationInterval);
+
+    // Requests the connection parameters depending on the traffic, disabled by default
+    ConnectionParameterPolicy *connectionParameterPolicy() const;
+
+    // Provides the link security of a session for services using BluetoothService::EncryptionPolicyLinkLayerSufficient.
+    // By default the link mode of the connection will be read from the kernel (HciLinkSecurityProvider).
+    LinkSecurityProvider *linkSecurityProvider() const;
+    void setLinkSecurityProvider(LinkSecurityProvider *linkSecurityProvider);
+
 private:
     QString m_advertiseName;
     QString m_modelName;
@@ -105,19 +222,115 @@ private:
     EncryptionService *m_encryptionService = nullptr;
     NetworkService *m_networkService = nullptr;
     WirelessService *m_wirelessService = nullptr;
+    WirelessScanManager *m_wirelessScanManager = nullptr;
+    InterfaceAddressCache *m_interfaceAddressCache = nullptr;
+    int m_notificationInterval = 200;
+
+    LinkSecurityProvider *m_linkSecurityProvider = nullptr;
+    ConnectionParameterPolicy *m_connectionParameterPolicy = nullptr;
+    QList<BluetoothServiceDataHandler *> m_dataHandlers;
 
-    EncryptionHandler *m_encryptionHandler = nullptr;
+    BluetoothSession *m_session = nullptr;
+    int m_rekeyMessageLimit = 0;
+    qint64 m_rekeyByteLimit = 0;
+
+    int m_sessionIdleTimeout = 0;
+    QTimer m_sessionIdleTimer;
+    QList<SessionRecord> m_sessionHistory;
+    int m_sessionHistoryLimit = 32;
+    QMap<SessionCloseReason, int> m_sessionCloseReasonCounts;
 
     bool m_running = false;
     bool m_connected = false;
 
+    int m_connectionCount = 0;
+    qint64 m_connectedDuration = 0;
+    QElapsedTimer m_connectedTimer;
+
+    bool m_warmRestartEnabled = false;
+    QElapsedTimer m_readvertiseTimer;
+    qint64 m_readvertiseDuration = -1;
+    QElapsedTimer m_startupTimer;
+    qint64 m_startupDuration = -1;
+
+    // Advertising schedule
+    int m_fastAdvertisingInterval = 100;
+    int m_fastAdvertisingDuration = 0;
+    int m_slowAdvertisingInterval = 1000;
+    AdvertisingMode m_advertisingMode = AdvertisingModeFast;
+    QTimer m_advertisingModeTimer;
+    QElapsedTimer m_advertisingTimer;
+    QMap<AdvertisingMode, qint64> m_advertisingModeDurations;
+
+    // Advertised status
+    quint16 m_manufacturerId = 0xffff;
+    quint16 m_configurationGeneration = 0;
+    QByteArray m_advertisedStatus;
+    QTimer m_statusUpdateTimer;
+    QElapsedTimer m_statusUpdateElapsedTimer;
+    int m_statusUpdateInterval = 10000;
+    // A client is probably still busy with the device shortly after it disconnected
+    QTimer m_sessionBusyTimer;
+    int m_sessionBusyDuration = 30000;
+
+    // Startup state machine
+    StartupPhase m_startupPhase = StartupPhaseIdle;
+    QElapsedTimer m_startupPhaseTimer;
+    QMap<StartupPhase, qint64> m_startupPhaseDurations;
+    QTimer m_startupTimeoutTimer;
+    QTimer m_startupRetryTimer;
+    // The retries failed, the server will be stopped from the retry timer
+    bool m_startupFailed = false;
+    int m_startupTimeout = 5000;
+    int m_startupRetryDelay = 500;
+    int m_startupRetryLimit = 5;
+    int m_startupAttempt = 0;
+    QTimer m_restartTimer;
+    int m_restartDelay = 60000;
+
+    // Cached GATT database, invalid service data will be built on start
+    QLowEnergyServiceData m_deviceInfoServiceData;
+    QLowEnergyServiceData m_genericAccessServiceData;
+    QLowEnergyServiceData m_genericAttributeServiceData;
+    QHash<BluetoothService *, QLowEnergyServiceData> m_registeredServiceData;
+
+    // Incremented on each service change, used to decide if a bonded client needs the service changed indication
+    quint32 m_databaseVersion = 0;
+    QMap<QBluetoothAddress, quint32> m_clientDatabaseVersions;
+    int m_clientDatabaseVersionsLimit = 32;
+
+    // Services of unregistered services, deleted once the database will be rebuilt
+    QList<QPointer<QLowEnergyService>> m_unregisteredServices;
+
     void registerDeprecatedServices();
 
+    void startAdapter();
+    void startController();
+    void releaseAdapter();
+    void releaseController();
+    void scheduleStartupRetry();
+    void setStartupPhase(StartupPhase startupPhase);
+
+    void buildServiceData();
+    void addServices();
+    void updateServices();
+    void indicateServiceChanged(const QBluetoothAddress &remoteAddress);
+    static bool serviceHandleRange(QLowEnergyService *service, quint16 &startHandle, quint16 &endHandle);
+    void pruneClientDatabaseVersions();
+    BluetoothServiceDataHandler *findDataHandler(BluetoothService *bluetoothService) const;
+    void startAdvertising();
+    void setAdvertisingMode(AdvertisingMode advertisingMode);
+    void updateAdvertisingTime();
+    QByteArray statusData() const;
+    void warmRestart();
+
+    BluetoothSession *openSession(const QBluetoothAddress &remoteAddress);
+    void closeSession(SessionCloseReason closeReason);
+
     QLowEnergyServiceData deviceInformationServiceData();
     QLowEnergyServiceData genericAccessServiceData();
     QLowEnergyServiceData genericAttributeServiceData();
 
-    QList<QBluetoothUuid> m_serviceUuids;
     QList<BluetoothService *> m_registeredServices;
 
     void setRunning(bool running);
@@ -127,6 +340,7 @@ private:
 
 signals:
     void runningChanged(const bool &running);
+    void startupFailed();
     void connectedChanged(const bool &connected);
 
 private slots:
@@ -135,11 +349,19 @@ private slots:
     void onDeviceConnected(const QBluetoothAddress &address);
     void onDeviceDisconnected(const QBluetoothAddress &address);
     void onError(QLowEnergyController::Error error);
+    void onStartupTimeout();
+    void onStartupRetry();
+    void onSessionIdleTimeout();
 
     // Bluetooth controller
     void onConnected();
     void onDisconnected();
     void onControllerStateChanged(QLowEnergyController::ControllerState state);
+    void onConnectionUpdateRequested(const QLowEnergyConnectionParameters &parameters);
+    void onConnectionUpdated(const QLowEnergyConnectionParameters &parameters);
+
+    void onNetworkManagerStateChanged();
+    void updateAdvertisedStatus();
 
     // Services
     void characteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &value);
@@ -153,6 +375,9 @@ public slots:
     void start();
     void stop();
 
+    // Advertise with the fast interval again, i.e. on a button press
+    void triggerFastAdvertising();
+
 };
 
 #endif // BLUETOOTHSERVER_H
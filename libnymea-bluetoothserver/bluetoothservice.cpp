@@ -0,0 +1,262 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "bluetoothservice.h"
+#include "bluetoothsession.h"
+#include "loggingcategories.h"
+
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QJsonParseError>
+
+void BluetoothService::setSession(BluetoothSession *session)
+{
+    if (m_session != session)
+        m_subscriptions.clear();
+
+    m_session = session;
+}
+
+bool BluetoothService::senderNotificationsEnabled() const
+{
+    return !m_session.isNull() && m_session->notificationsEnabled(senderCharacteristicUuid());
+}
+
+void BluetoothService::registerMethod(int method, const BluetoothService::ParamsSchema &paramsSchema, BluetoothService::MethodHandler handler)
+{
+    Q_ASSERT_X(!m_methods.contains(method), "BluetoothService", "method already registered.");
+    RegisteredMethod registeredMethod;
+    registeredMethod.paramsSchema = paramsSchema;
+    registeredMethod.handler = handler;
+    m_methods.insert(method, registeredMethod);
+}
+
+void BluetoothService::sendResponse(int method, int responseCode, const JsonWriter &responseParams)
+{
+    JsonWriter response;
+    response.beginObject();
+    response.writeKey("c");
+    response.writeValue(method);
+    response.writeKey("r");
+    response.writeValue(responseCode);
+    if (!responseParams.isEmpty()) {
+        response.writeKey("p");
+        response.writeRawValue(responseParams.data());
+    }
+    response.endObject();
+
+    sendData(response.data());
+}
+
+void BluetoothService::receiveData(const QByteArray &data)
+{
+    qCDebug(dcNymeaBluetoothServer()) << name() << "message received" << qUtf8Printable(data);
+
+    QJsonParseError jsonError;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &jsonError);
+    if (jsonError.error != QJsonParseError::NoError) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "received invalid json data" << jsonError.errorString() << qUtf8Printable(data);
+        sendResponse(MethodUnknown, ResponseCodeInvalidProtocol);
+        return;
+    }
+
+    QJsonObject requestData = jsonDoc.object();
+    QJsonValue methodValue = requestData.value("c");
+    if (!methodValue.isDouble()) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "received invalid request data. The method property \"c\" is not included or not a number" << qUtf8Printable(data);
+        sendResponse(MethodUnknown, ResponseCodeInvalidProtocol);
+        return;
+    }
+
+    int method = methodValue.toInt();
+
+    QHash<int, RegisteredMethod>::const_iterator registeredMethod = m_methods.constFind(method);
+    if (registeredMethod == m_methods.constEnd()) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "invalid method received. There is no method/command with id" << method;
+        sendResponse(method, ResponseCodeInvalidMethod);
+        return;
+    }
+
+    QJsonObject params;
+    if (requestData.contains("p")) {
+        if (!requestData.value("p").isObject()) {
+            qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "invalid params for method" << method << "The params are not an object.";
+            sendResponse(method, ResponseCodeInvalidParams);
+            return;
+        }
+        params = requestData.value("p").toObject();
+    }
+
+    foreach (const QString &paramName, registeredMethod->paramsSchema.keys()) {
+        if (!paramValid(params.value(paramName), registeredMethod->paramsSchema.value(paramName))) {
+            qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "invalid params for method" << method << "The param" << paramName << "is missing or has the wrong type.";
+            sendResponse(method, ResponseCodeInvalidParams);
+            return;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    registeredMethod->handler(params);
+    qint64 duration = timer.nsecsElapsed();
+
+    MethodStatistics &statistics = m_methodStatistics[method];
+    statistics.calls++;
+    statistics.totalDuration += duration;
+    statistics.maxDuration = qMax(statistics.maxDuration, duration);
+    qCDebug(dcNymeaBluetoothServer()) << name() << "method" << method << "processed in" << duration / 1000 << "us";
+}
+
+void BluetoothService::enableSubscriptions(int subscribeMethod, int unsubscribeMethod)
+{
+    registerMethod(subscribeMethod, {{"n", QJsonValue::Double}}, [this, subscribeMethod](const QJsonObject &params) { subscribe(subscribeMethod, params); });
+    registerMethod(unsubscribeMethod, {{"n", QJsonValue::Double}}, [this, unsubscribeMethod](const QJsonObject &params) { unsubscribe(unsubscribeMethod, params); });
+}
+
+void BluetoothService::registerNotification(int notification, NotificationFilter filter)
+{
+    Q_ASSERT_X(!m_notifications.contains(notification), "BluetoothService", "notification already registered.");
+    m_notifications.insert(notification, filter);
+}
+
+bool BluetoothService::subscribed(int notification) const
+{
+    return m_subscriptions.contains(notification);
+}
+
+void BluetoothService::sendNotification(int notification, const QJsonObject &params, bool onlyChanges)
+{
+    QHash<int, Subscription>::iterator subscription = m_subscriptions.find(notification);
+    if (subscription == m_subscriptions.end() || !senderNotificationsEnabled())
+        return;
+
+    QJsonObject notificationParams = params;
+    NotificationFilter filter = m_notifications.value(notification);
+    bool matches = filter ? filter(subscription->filter, notificationParams) : filterMatches(subscription->filter, notificationParams);
+    if (!matches)
+        return;
+
+    // Only push changes, the client still knows the last notification
+    QByteArray paramsData = QJsonDocument(notificationParams).toJson(QJsonDocument::Compact);
+    if (onlyChanges && subscription->notified && subscription->lastParams == paramsData)
+        return;
+
+    subscription->lastParams = paramsData;
+    subscription->notified = true;
+    writeNotification(notification, notificationParams, paramsData);
+}
+
+void BluetoothService::sendRequestedNotification(int notification, const QJsonObject &params)
+{
+    if (m_session.isNull())
+        return;
+
+    // Keep a subscription in sync, so a subscribed client will not get the same notification twice
+    QByteArray paramsData = QJsonDocument(params).toJson(QJsonDocument::Compact);
+    QHash<int, Subscription>::iterator subscription = m_subscriptions.find(notification);
+    if (subscription != m_subscriptions.end()) {
+        subscription->lastParams = paramsData;
+        subscription->notified = true;
+    }
+
+    writeNotification(notification, params, paramsData);
+}
+
+void BluetoothService::writeNotification(int notification, const QJsonObject &params, const QByteArray &paramsData)
+{
+    JsonWriter writer(paramsData.count() + 16);
+    writer.beginObject();
+    writer.writeKey("n");
+    writer.writeValue(notification);
+    if (!params.isEmpty()) {
+        writer.writeKey("p");
+        writer.writeRawValue(paramsData);
+    }
+    writer.endObject();
+
+    qCDebug(dcNymeaBluetoothServer()) << name() << "sending notification" << notification;
+    sendData(writer.data());
+}
+
+void BluetoothService::subscribe(int method, const QJsonObject &params)
+{
+    int notification = params.value("n").toInt();
+    if (!m_notifications.contains(notification)) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "cannot subscribe unknown notification" << notification;
+        sendResponse(method, ResponseCodeInvalidParams);
+        return;
+    }
+
+    if (params.contains("f") && !params.value("f").isObject()) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "invalid filter for notification" << notification << "The filter is not an object.";
+        sendResponse(method, ResponseCodeInvalidParams);
+        return;
+    }
+
+    // Note: subscribing again replaces the filter, the next notification will be sent in any case
+    Subscription subscription;
+    subscription.filter = params.value("f").toObject();
+    m_subscriptions.insert(notification, subscription);
+    qCDebug(dcNymeaBluetoothServer()) << name() << "notification" << notification << "subscribed";
+    sendResponse(method, ResponseCodeSuccess);
+}
+
+void BluetoothService::unsubscribe(int method, const QJsonObject &params)
+{
+    int notification = params.value("n").toInt();
+    if (!m_notifications.contains(notification)) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "cannot unsubscribe unknown notification" << notification;
+        sendResponse(method, ResponseCodeInvalidParams);
+        return;
+    }
+
+    m_subscriptions.remove(notification);
+    qCDebug(dcNymeaBluetoothServer()) << name() << "notification" << notification << "unsubscribed";
+    sendResponse(method, ResponseCodeSuccess);
+}
+
+bool BluetoothService::paramValid(const QJsonValue &value, QJsonValue::Type type)
+{
+    if (value.isUndefined())
+        return false;
+
+    return value.type() == type;
+}
+
+bool BluetoothService::filterMatches(const QJsonObject &filter, const QJsonObject &params)
+{
+    for (QJsonObject::const_iterator it = filter.constBegin(); it != filter.constEnd(); ++it) {
+        if (params.value(it.key()) != it.value()) {
+            return false;
+        }
+    }
+
+    return true;
+}
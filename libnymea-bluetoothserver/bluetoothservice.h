@@ -31,14 +31,60 @@
 #ifndef BLUETOOTHSERVICE_H
 #define BLUETOOTHSERVICE_H
 
+#include <QHash>
 #include <QObject>
+#include <QPointer>
+#include <QJsonObject>
 #include <QBluetoothUuid>
 #include <QLowEnergyServiceData>
 
+#include <functional>
+
+#include "jsonwriter.h"
+
+class BluetoothSession;
+
 class BluetoothService : public QObject
 {
     Q_OBJECT
 public:
+    // Defines what satisfies useEncryption() for this service
+    enum EncryptionPolicy {
+        EncryptionPolicyApplication,          // Only the application level encryption established using the encryption service
+        EncryptionPolicyLinkLayerSufficient   // Also a link encrypted using an authenticated LE Secure Connections bond
+    };
+    Q_ENUM(EncryptionPolicy)
+
+    // Response codes shared by all services. Services may define additional codes starting from ResponseCodeCustom.
+    enum ResponseCode {
+        ResponseCodeSuccess = 0,
+        ResponseCodeInvalidProtocol = 1,
+        ResponseCodeInvalidMethod = 2,
+        ResponseCodeInvalidParams = 3,
+        ResponseCodeCustom = 4
+    };
+    Q_ENUM(ResponseCode)
+
+    // Method unknown, used in responses if the request could not be parsed
+    static const int MethodUnknown = -1;
+
+    // Required parameters of a method and the expected type of the value.
+    // The params will be passed to the handler as parsed from the wire, without converting them to a QVariantMap.
+    typedef QHash<QString, QJsonValue::Type> ParamsSchema;
+    typedef std::function<void(const QJsonObject &params)> MethodHandler;
+
+    // Decides if a notification matches the filter of the subscription and may reduce the params to the matching data
+    typedef std::function<bool(const QJsonObject &filter, QJsonObject &params)> NotificationFilter;
+
+    class MethodStatistics
+    {
+    public:
+        quint64 calls = 0;
+        qint64 totalDuration = 0; // ns
+        qint64 maxDuration = 0;   // ns
+        qint64 averageDuration() const { return calls > 0 ? static_cast<qint64>(totalDuration / static_cast<qint64>(calls)) : 0; };
+    };
+
     explicit BluetoothService(QObject *parent = nullptr) : QObject(parent) { };
     virtual ~BluetoothService() = default;
 
@@ -49,14 +95,77 @@ public:
 
     virtual bool useEncryption() const = 0;
 
+    // Note: the characteristics are accessible by any client, the policy only decides which data will be processed
+    EncryptionPolicy encryptionPolicy() const { return m_encryptionPolicy; };
+    void setEncryptionPolicy(EncryptionPolicy encryptionPolicy) { m_encryptionPolicy = encryptionPolicy; };
+
+    // The session of the currently connected client, nullptr if no client is connected
+    // Note: the subscriptions belong to the session and will be removed once the session changes
+    BluetoothSession *session() const { return m_session; };
+    void setSession(BluetoothSession *session);
+
+    // True if the client of the session enabled the notifications of the sender characteristic.
+    // Subscribed notifications will not be built at all otherwise, responses will always be sent.
+    bool senderNotificationsEnabled() const;
+
+    // Call count and handler duration of each registered method
+    QHash<int, MethodStatistics> methodStatistics() const { return m_methodStatistics; };
+
 signals:
     void requestSendData(const QByteArray &data);
 
 protected:
     void sendData(const QByteArray &data) { emit requestSendData(data); };
 
+    void registerMethod(int method, const ParamsSchema &paramsSchema, MethodHandler handler);
+    // The params will be sent as written, without building a QVariant tree
+    void sendResponse(int method, int responseCode = ResponseCodeSuccess, const JsonWriter &responseParams = JsonWriter());
+
+    // Notifications will only be sent to clients which subscribed them using the given methods.
+    // Without a filter function, each key of the subscription filter has to match the value in the params.
+    void enableSubscriptions(int subscribeMethod, int unsubscribeMethod);
+    void registerNotification(int notification, NotificationFilter filter = NotificationFilter());
+    bool subscribed(int notification) const;
+    // Sends the notification if subscribed, matching the filter and, unless onlyChanges is false, different to the last one sent
+    void sendNotification(int notification, const QJsonObject &params = QJsonObject(), bool onlyChanges = true);
+    // Sends the notification to the client of the session even without a subscription or a matching filter.
+    // Used for the progress of an operation the client started itself.
+    void sendRequestedNotification(int notification, const QJsonObject &params = QJsonObject());
+
 public slots:
-    virtual void receiveData(const QByteArray &data) = 0;
+    // Default implementation: parse the request and dispatch it to the registered method handler
+    virtual void receiveData(const QByteArray &data);
+
+private:
+    class RegisteredMethod
+    {
+    public:
+        ParamsSchema paramsSchema;
+        MethodHandler handler;
+    };
+
+    class Subscription
+    {
+    public:
+        QJsonObject filter;
+        QByteArray lastParams;
+        bool notified = false;
+    };
+
+    EncryptionPolicy m_encryptionPolicy = EncryptionPolicyApplication;
+    QPointer<BluetoothSession> m_session;
+    QHash<int, RegisteredMethod> m_methods;
+    QHash<int, MethodStatistics> m_methodStatistics;
+    QHash<int, NotificationFilter> m_notifications;
+    QHash<int, Subscription> m_subscriptions;
+
+    void writeNotification(int notification, const QJsonObject &params, const QByteArray &paramsData);
+
+    void subscribe(int method, const QJsonObject &params);
+    void unsubscribe(int method, const QJsonObject &params);
+
+    static bool paramValid(const QJsonValue &value, QJsonValue::Type type);
+    static bool filterMatches(const QJsonObject &filter, const QJsonObject &params);
 
 };
 
@@ -33,12 +33,36 @@
 
 #include <QDataStream>
 
-BluetoothServiceDataHandler::BluetoothServiceDataHandler(EncryptionHandler *enryptionHandler, QLowEnergyService *service, BluetoothService *bluetoothService, QObject *parent) :
+BluetoothServiceDataHandler::BluetoothServiceDataHandler(QLowEnergyService *service, BluetoothService *bluetoothService, QObject *parent) :
     QObject(parent),
-    m_enryptionHandler(enryptionHandler),
-    m_service(service),
     m_bluetoothService(bluetoothService)
 {
+    connect(m_bluetoothService, &BluetoothService::requestSendData, this, &BluetoothServiceDataHandler::sendData);
+    setService(service);
+}
+
+BluetoothService *BluetoothServiceDataHandler::bluetoothService() const
+{
+    return m_bluetoothService;
+}
+
+QLowEnergyService *BluetoothServiceDataHandler::service() const
+{
+    return m_service;
+}
+
+void BluetoothServiceDataHandler::setService(QLowEnergyService *service)
+{
+    if (m_service)
+        disconnect(m_service, nullptr, this, nullptr);
+
+    m_service = service;
+    m_receiverHandle = 0;
+    m_senderCharacteristic = QLowEnergyCharacteristic();
+
+    if (!m_service)
+        return;
+
     // Create characteristic connections
     connect(m_service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
     connect(m_service, SIGNAL(characteristicRead(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
@@ -46,7 +70,64 @@ BluetoothServiceDataHandler::BluetoothServiceDataHandler(EncryptionHandler *enry
     connect(m_service, SIGNAL(descriptorWritten(QLowEnergyDescriptor, QByteArray)), this, SLOT(descriptorWritten(QLowEnergyDescriptor, QByteArray)));
     connect(m_service, SIGNAL(error(QLowEnergyService::ServiceError)), this, SLOT(serviceError(QLowEnergyService::ServiceError)));
 
-    connect(m_bluetoothService, &BluetoothService::requestSendData, this, &BluetoothServiceDataHandler::sendData);
+    // Resolve the characteristics once, so the data path does not need any uuid lookups
+    QLowEnergyCharacteristic receiverCharacteristic = m_service->characteristic(m_bluetoothService->receiverCharacteristicUuid());
+    if (receiverCharacteristic.isValid()) {
+        m_receiverHandle = receiverCharacteristic.handle();
+    } else {
+        qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "receiver characteristic not valid" << m_bluetoothService->receiverCharacteristicUuid().toString();
+    }
+
+    m_senderCharacteristic = m_service->characteristic(m_bluetoothService->senderCharacteristicUuid());
+    if (!m_senderCharacteristic.isValid()) {
+        qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "sender characteristic not valid" << m_bluetoothService->senderCharacteristicUuid().toString();
+    }
+
+    if (!m_session.isNull()) {
+        m_session->loadClientConfigurations(m_service);
+    }
+}
+
+BluetoothSession *BluetoothServiceDataHandler::session() const
+{
+    return m_session;
+}
+
+void BluetoothServiceDataHandler::setSession(BluetoothSession *session)
+{
+    m_session = session;
+    if (!m_session.isNull()) {
+        m_session->loadClientConfigurations(m_service);
+    }
+}
+
+BluetoothServiceDataHandler::TransportSecurity BluetoothServiceDataHandler::transportSecurity() const
+{
+    if (m_session.isNull())
+        return m_bluetoothService->useEncryption() ? TransportSecurityInsufficient : TransportSecurityPlain;
+
+    // Only read the link security if it can make a difference
+    bool encryptionReady = m_session->encryptionHandler()->ready();
+    LinkSecurityProvider::LinkSecurity linkSecurity = LinkSecurityProvider::LinkSecurityNone;
+    if (m_bluetoothService->useEncryption() && !encryptionReady && m_bluetoothService->encryptionPolicy() == BluetoothService::EncryptionPolicyLinkLayerSufficient)
+        linkSecurity = m_session->linkSecurity();
+
+    return selectTransportSecurity(m_bluetoothService->useEncryption(), m_bluetoothService->encryptionPolicy(), encryptionReady, linkSecurity);
+}
+
+BluetoothServiceDataHandler::TransportSecurity BluetoothServiceDataHandler::selectTransportSecurity(bool useEncryption, BluetoothService::EncryptionPolicy encryptionPolicy, bool encryptionReady, LinkSecurityProvider::LinkSecurity linkSecurity)
+{
+    if (!useEncryption)
+        return TransportSecurityPlain;
+
+    // Once established by the client, the application encryption will always be used
+    if (encryptionReady)
+        return TransportSecurityApplication;
+
+    if (encryptionPolicy == BluetoothService::EncryptionPolicyLinkLayerSufficient && linkSecurity == LinkSecurityProvider::LinkSecurityAuthenticated)
+        return TransportSecurityLinkLayer;
+
+    return TransportSecurityInsufficient;
 }
 
 QByteArray BluetoothServiceDataHandler::unescapeData(const QByteArray &data)
@@ -115,39 +196,60 @@ void BluetoothServiceDataHandler::processPackage(const QByteArray &package)
 
     // Decrypt data
     QByteArray data;
-    if (m_enryptionHandler->ready() && m_bluetoothService->useEncryption()) {
-        QByteArray nonce = package.left(32);
-        QByteArray data = package.right(package.length() - 33);
-        data = m_enryptionHandler->decryptData(data, nonce);
-    } else {
+    switch (transportSecurity()) {
+    case TransportSecurityInsufficient:
+        qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "requires encryption, but neither the encryption has been established nor the link is secure. Ignoring data.";
+        return;
+    case TransportSecurityApplication:
+        data = m_session->encryptionHandler()->decryptPackage(package);
+        if (data.isNull()) {
+            qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "failed to decrypt package. Ignoring data.";
+            return;
+        }
+        break;
+    case TransportSecurityPlain:
+    case TransportSecurityLinkLayer:
         data = package;
+        break;
     }
 
     // Process
-    m_bluetoothService->receiveData(package);
+    m_bluetoothService->receiveData(data);
 }
 
 void BluetoothServiceDataHandler::characteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &value)
 {
-    if (characteristic.uuid() == m_bluetoothService->receiverCharacteristicUuid()) {
-        // Add data to the buffer and check if the package is complete. If so, process the data
+    if (m_receiverHandle != 0 && characteristic.handle() == m_receiverHandle) {
+        if (m_session.isNull()) {
+            qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "received data without a client session. Ignoring data" << value.toHex();
+            return;
+        }
+
+        m_session->notifyDataReceived(value.count());
+
+        // Add data to the buffer of the session and check if the package is complete. If so, process the data
+        QByteArray &dataBuffer = m_session->receiveBuffer(m_bluetoothService->serviceUuid());
         for (int i = 0; i < value.length(); i++) {
             quint8 byte = static_cast<quint8>(value.at(i));
             if (byte == ProtocolByteEnd) {
                 // If there is no data...continue since it might be a starting END byte
-                if (m_dataBuffer.isEmpty())
+                if (dataBuffer.isEmpty())
                     continue;
 
-                qCDebug(dcNymeaBluetoothServerTraffic()) << m_bluetoothService->name() << "<--" << m_dataBuffer.toHex();
-                QByteArray package = unescapeData(m_dataBuffer);
+                qCDebug(dcNymeaBluetoothServerTraffic()) << m_bluetoothService->name() << "<--" << dataBuffer.toHex();
+                QByteArray package = unescapeData(dataBuffer);
+                dataBuffer.clear();
                 if (package.isNull()) {
-                    qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "received inconsistant package. Ignoring data" << m_dataBuffer.toHex();
+                    qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "received inconsistant package. Ignoring data";
                 } else {
                     processPackage(package);
                 }
-                m_dataBuffer.clear();
+
+                // Note: the session might have been closed while processing the package
+                if (m_session.isNull())
+                    return;
             } else {
-                m_dataBuffer.append(value.at(i));
+                dataBuffer.append(value.at(i));
             }
         }
     } else {
@@ -173,6 +275,9 @@ void BluetoothServiceDataHandler::descriptorRead(const QLowEnergyDescriptor &des
 void BluetoothServiceDataHandler::descriptorWritten(const QLowEnergyDescriptor &descriptor, const QByteArray &value)
 {
     qCDebug(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "descriptor written" << descriptor.uuid().toString() << value;
+    if (!m_session.isNull()) {
+        m_session->updateClientConfiguration(m_service, descriptor, value);
+    }
 }
 
 void BluetoothServiceDataHandler::serviceError(const QLowEnergyService::ServiceError &error)
@@ -207,34 +312,44 @@ void BluetoothServiceDataHandler::serviceError(const QLowEnergyService::ServiceE
 
 void BluetoothServiceDataHandler::sendData(const QByteArray &data)
 {
+    if (m_session.isNull()) {
+        qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "no client session available. Not sending data.";
+        return;
+    }
+
     QByteArray finalData;
     // Encrypt
-    if (m_enryptionHandler->ready() && m_bluetoothService->useEncryption()) {
-        QByteArray nonce = m_enryptionHandler->generateNonce();
-        QByteArray encryptedData = m_enryptionHandler->encryptData(data, nonce);
-        finalData = nonce + encryptedData;
-    } else {
+    switch (transportSecurity()) {
+    case TransportSecurityInsufficient:
+        qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "requires encryption, but neither the encryption has been established nor the link is secure. Not sending data.";
+        return;
+    case TransportSecurityApplication:
+        finalData = m_session->encryptionHandler()->encryptPackage(data);
+        if (finalData.isEmpty()) {
+            qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "failed to encrypt data. Not sending data.";
+            return;
+        }
+        break;
+    case TransportSecurityPlain:
+    case TransportSecurityLinkLayer:
         finalData = data;
+        break;
     }
 
     // Escape
     QByteArray frame = escapeData(finalData);
 
     // Write
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(m_bluetoothService->senderCharacteristicUuid());
-    if (!characteristic.isValid()) {
+    if (!m_service || !m_senderCharacteristic.isValid()) {
         qCWarning(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "sender characteristic not valid" << m_bluetoothService->senderCharacteristicUuid().toString();
         return;
     }
 
     qCDebug(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "start streaming escaped data:" << frame.count() << "bytes";
-    int sentDataLength = 0;
-    QByteArray remainingData = frame;
-    while (!remainingData.isEmpty()) {
-        QByteArray package = remainingData.left(20);
-        sentDataLength += package.count();
-        m_service->writeCharacteristic(characteristic, package);
-        remainingData = remainingData.remove(0, package.count());
+    // Note: the stack queues the notifications, with one connection per controller there is nothing to pace
+    m_session->notifyDataSent(frame.count());
+    for (int offset = 0; offset < frame.count(); offset += 20) {
+        m_service->writeCharacteristic(m_senderCharacteristic, frame.mid(offset, 20));
     }
 
     qCDebug(dcNymeaBluetoothServer()) << m_bluetoothService->name() << "finished streaming response data";
@@ -32,16 +32,38 @@
 #define BLUETOOTHSERVICEDATAHANDLER_H
 
 #include <QObject>
+#include <QPointer>
 #include <QLowEnergyService>
 
-#include "encryptionhandler.h"
 #include "bluetoothservice.h"
+#include "bluetoothsession.h"
 
 class BluetoothServiceDataHandler : public QObject
 {
     Q_OBJECT
 public:
-    explicit BluetoothServiceDataHandler(EncryptionHandler *enryptionHandler, QLowEnergyService *service, BluetoothService *bluetoothService, QObject *parent = nullptr);
+    enum TransportSecurity {
+        TransportSecurityPlain,
+        TransportSecurityApplication,
+        TransportSecurityLinkLayer,
+        TransportSecurityInsufficient
+    };
+    Q_ENUM(TransportSecurity)
+
+    explicit BluetoothServiceDataHandler(QLowEnergyService *service, BluetoothService *bluetoothService, QObject *parent = nullptr);
+
+    BluetoothService *bluetoothService() const;
+
+    // The service will be replaced if the services have been added again to the controller
+    QLowEnergyService *service() const;
+    void setService(QLowEnergyService *service);
+
+    // The session of the connected client, data will only be processed and sent while a session is set
+    BluetoothSession *session() const;
+    void setSession(BluetoothSession *session);
+
+    TransportSecurity transportSecurity() const;
+    static TransportSecurity selectTransportSecurity(bool useEncryption, BluetoothService::EncryptionPolicy encryptionPolicy, bool encryptionReady, LinkSecurityProvider::LinkSecurity linkSecurity);
 
 private:
     enum ProtocolByte {
@@ -51,10 +73,13 @@ private:
         ProtocolByteTransposedEsc = 0xDD
     };
 
-    EncryptionHandler *m_enryptionHandler = nullptr;
     QLowEnergyService *m_service = nullptr;
     BluetoothService *m_bluetoothService = nullptr;
-    QByteArray m_dataBuffer;
+    QPointer<BluetoothSession> m_session;
+
+    // Resolved once on creation, used for dispatching incoming writes and sending
+    QLowEnergyHandle m_receiverHandle = 0;
+    QLowEnergyCharacteristic m_senderCharacteristic;
 
     QByteArray unescapeData(const QByteArray &data);
     QByteArray escapeData(const QByteArray &data);
@@ -0,0 +1,164 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "bluetoothsession.h"
+#include "loggingcategories.h"
+
+BluetoothSession::BluetoothSession(const QBluetoothAddress &remoteAddress, QObject *parent) :
+    QObject(parent),
+    m_remoteAddress(remoteAddress)
+{
+    m_encryptionHandler = new EncryptionHandler(this);
+    m_durationTimer.start();
+    m_receiveTimer.start();
+}
+
+QBluetoothAddress BluetoothSession::remoteAddress() const
+{
+    return m_remoteAddress;
+}
+
+EncryptionHandler *BluetoothSession::encryptionHandler() const
+{
+    return m_encryptionHandler;
+}
+
+LinkSecurityProvider *BluetoothSession::linkSecurityProvider() const
+{
+    return m_linkSecurityProvider;
+}
+
+void BluetoothSession::setLinkSecurityProvider(LinkSecurityProvider *linkSecurityProvider)
+{
+    m_linkSecurityProvider = linkSecurityProvider;
+    m_linkSecurity = LinkSecurityProvider::LinkSecurityNone;
+}
+
+LinkSecurityProvider::LinkSecurity BluetoothSession::linkSecurity()
+{
+    // Note: the security of a link can only be raised, so an authenticated link does not need to be read again
+    if (m_linkSecurity == LinkSecurityProvider::LinkSecurityAuthenticated || m_linkSecurityProvider.isNull())
+        return m_linkSecurity;
+
+    LinkSecurityProvider::LinkSecurity linkSecurity = m_linkSecurityProvider->linkSecurity(m_remoteAddress);
+    if (linkSecurity != m_linkSecurity) {
+        qCDebug(dcNymeaBluetoothServer()) << "Link security of" << m_remoteAddress.toString() << "changed to" << linkSecurity;
+        m_linkSecurity = linkSecurity;
+    }
+
+    return m_linkSecurity;
+}
+
+QByteArray &BluetoothSession::receiveBuffer(const QBluetoothUuid &serviceUuid)
+{
+    return m_receiveBuffers[serviceUuid];
+}
+
+void BluetoothSession::notifyDataReceived(int length)
+{
+    m_bytesReceived += length;
+    m_receiveTimer.start();
+    emit activity();
+}
+
+void BluetoothSession::notifyDataSent(int length)
+{
+    m_bytesSent += length;
+    emit activity();
+}
+
+qint64 BluetoothSession::bytesReceived() const
+{
+    return m_bytesReceived;
+}
+
+qint64 BluetoothSession::bytesSent() const
+{
+    return m_bytesSent;
+}
+
+qint64 BluetoothSession::duration() const
+{
+    return m_durationTimer.elapsed();
+}
+
+qint64 BluetoothSession::idleDuration() const
+{
+    return m_receiveTimer.elapsed();
+}
+
+bool BluetoothSession::notificationsEnabled(const QBluetoothUuid &characteristicUuid) const
+{
+    return m_notificationsEnabled.value(characteristicUuid, false);
+}
+
+void BluetoothSession::setNotificationsEnabled(const QBluetoothUuid &characteristicUuid, bool enabled)
+{
+    if (notificationsEnabled(characteristicUuid) == enabled)
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Notifications" << (enabled ? "enabled" : "disabled") << "by" << m_remoteAddress.toString() << "for characteristic" << characteristicUuid.toString();
+    m_notificationsEnabled.insert(characteristicUuid, enabled);
+}
+
+bool BluetoothSession::updateClientConfiguration(QLowEnergyService *service, const QLowEnergyDescriptor &descriptor, const QByteArray &value)
+{
+    if (!service || descriptor.uuid() != QBluetoothUuid(QBluetoothUuid::ClientCharacteristicConfiguration))
+        return false;
+
+    // Note: the descriptor does not know its characteristic, find it using the handle
+    foreach (const QLowEnergyCharacteristic &characteristic, service->characteristics()) {
+        if (characteristic.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration).handle() == descriptor.handle()) {
+            setNotificationsEnabled(characteristic.uuid(), clientConfigurationEnabled(value));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void BluetoothSession::loadClientConfigurations(QLowEnergyService *service)
+{
+    if (!service)
+        return;
+
+    foreach (const QLowEnergyCharacteristic &characteristic, service->characteristics()) {
+        QLowEnergyDescriptor descriptor = characteristic.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
+        if (descriptor.isValid()) {
+            setNotificationsEnabled(characteristic.uuid(), clientConfigurationEnabled(descriptor.value()));
+        }
+    }
+}
+
+bool BluetoothSession::clientConfigurationEnabled(const QByteArray &value)
+{
+    // Bit 0: notifications, bit 1: indications
+    return !value.isEmpty() && (static_cast<quint8>(value.at(0)) & 0x03) != 0;
+}
@@ -0,0 +1,107 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef BLUETOOTHSESSION_H
+#define BLUETOOTHSESSION_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QBluetoothUuid>
+#include <QBluetoothAddress>
+#include <QLowEnergyService>
+#include <QLowEnergyDescriptor>
+#include <QLowEnergyCharacteristic>
+
+#include "encryptionhandler.h"
+#include "linksecurityprovider.h"
+
+// The state of one connected client. Created once a client connected and deleted on disconnect,
+// so nothing of a previous client will be available for the next one.
+class BluetoothSession : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BluetoothSession(const QBluetoothAddress &remoteAddress, QObject *parent = nullptr);
+
+    QBluetoothAddress remoteAddress() const;
+
+    EncryptionHandler *encryptionHandler() const;
+
+    // The security of the link will be read from the provider, since the client can pair or encrypt the link at any time
+    LinkSecurityProvider *linkSecurityProvider() const;
+    void setLinkSecurityProvider(LinkSecurityProvider *linkSecurityProvider);
+    LinkSecurityProvider::LinkSecurity linkSecurity();
+
+    // SLIP reassembly buffer of the given service
+    QByteArray &receiveBuffer(const QBluetoothUuid &serviceUuid);
+    void notifyDataReceived(int length);
+    void notifyDataSent(int length);
+
+    // Traffic of this session
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+    qint64 duration() const; // ms
+    // Time in ms since the client sent data, data sent by the server does not count
+    qint64 idleDuration() const; // ms
+
+    // Client characteristic configuration (0x2902) written by this client. Notifications of characteristics
+    // the client did not enable would be dropped by the stack, so they should not be built at all.
+    bool notificationsEnabled(const QBluetoothUuid &characteristicUuid) const;
+    void setNotificationsEnabled(const QBluetoothUuid &characteristicUuid, bool enabled);
+    // Returns false if the descriptor is not the client characteristic configuration of a characteristic of the service
+    bool updateClientConfiguration(QLowEnergyService *service, const QLowEnergyDescriptor &descriptor, const QByteArray &value);
+    // Takes over the current client characteristic configurations of the service, i.e. restored ones of a bonded client
+    void loadClientConfigurations(QLowEnergyService *service);
+
+private:
+    QBluetoothAddress m_remoteAddress;
+    EncryptionHandler *m_encryptionHandler = nullptr;
+    QPointer<LinkSecurityProvider> m_linkSecurityProvider;
+    LinkSecurityProvider::LinkSecurity m_linkSecurity = LinkSecurityProvider::LinkSecurityNone;
+
+    QHash<QBluetoothUuid, QByteArray> m_receiveBuffers;
+    QHash<QBluetoothUuid, bool> m_notificationsEnabled;
+
+    qint64 m_bytesReceived = 0;
+    qint64 m_bytesSent = 0;
+    QElapsedTimer m_durationTimer;
+    QElapsedTimer m_receiveTimer;
+
+    static bool clientConfigurationEnabled(const QByteArray &value);
+
+signals:
+    // Data has been received or sent
+    void activity();
+
+};
+
+#endif // BLUETOOTHSESSION_H
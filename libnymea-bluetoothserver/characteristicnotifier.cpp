@@ -0,0 +1,144 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "characteristicnotifier.h"
+#include "loggingcategories.h"
+
+CharacteristicNotifier::CharacteristicNotifier(QLowEnergyService *service, QObject *parent) :
+    QObject(parent),
+    m_service(service)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &CharacteristicNotifier::onTimeout);
+}
+
+int CharacteristicNotifier::minimumInterval() const
+{
+    return m_minimumInterval;
+}
+
+void CharacteristicNotifier::setMinimumInterval(int minimumInterval)
+{
+    m_minimumInterval = qMax(0, minimumInterval);
+}
+
+BluetoothSession *CharacteristicNotifier::session() const
+{
+    return m_session;
+}
+
+void CharacteristicNotifier::setSession(BluetoothSession *session)
+{
+    m_session = session;
+}
+
+int CharacteristicNotifier::conflatedCount() const
+{
+    return m_conflatedCount;
+}
+
+void CharacteristicNotifier::notify(const QBluetoothUuid &characteristicUuid, const QByteArray &value)
+{
+    CharacteristicState &state = m_characteristics[characteristicUuid];
+
+    // Nobody is listening, only the value for reading has to be up to date
+    if (m_session.isNull() || !m_session->notificationsEnabled(characteristicUuid)) {
+        write(characteristicUuid, state, value);
+        return;
+    }
+
+    if (state.pending) {
+        // Latest value wins, it will be sent once the interval is over
+        m_conflatedCount++;
+        state.pendingValue = value;
+        return;
+    }
+
+    if (!state.lastWriteTimer.isValid() || state.lastWriteTimer.elapsed() >= m_minimumInterval) {
+        write(characteristicUuid, state, value);
+        return;
+    }
+
+    state.pendingValue = value;
+    state.pending = true;
+
+    int remaining = static_cast<int>(m_minimumInterval - state.lastWriteTimer.elapsed());
+    if (!m_timer.isActive() || m_timer.remainingTime() > remaining) {
+        m_timer.start(remaining);
+    }
+}
+
+void CharacteristicNotifier::write(const QBluetoothUuid &characteristicUuid, CharacteristicState &state, const QByteArray &value)
+{
+    state.pending = false;
+    state.pendingValue.clear();
+
+    // Note: the state might have changed back within the interval, the client knows this value already
+    if (state.lastWriteTimer.isValid() && state.lastValue == value)
+        return;
+
+    if (m_service.isNull()) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not notify characteristic" << characteristicUuid.toString() << "Service not valid";
+        return;
+    }
+
+    QLowEnergyCharacteristic characteristic = m_service->characteristic(characteristicUuid);
+    if (!characteristic.isValid()) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not notify characteristic" << characteristicUuid.toString() << "Characteristic not valid";
+        return;
+    }
+
+    state.lastValue = value;
+    state.lastWriteTimer.start();
+    m_service->writeCharacteristic(characteristic, value);
+}
+
+void CharacteristicNotifier::onTimeout()
+{
+    // Send the values which are due and wake up again for the next one
+    int nextTimeout = -1;
+    for (QHash<QBluetoothUuid, CharacteristicState>::iterator it = m_characteristics.begin(); it != m_characteristics.end(); ++it) {
+        CharacteristicState &state = it.value();
+        if (!state.pending)
+            continue;
+
+        qint64 remaining = m_minimumInterval - state.lastWriteTimer.elapsed();
+        if (remaining <= 0) {
+            QByteArray value = state.pendingValue;
+            write(it.key(), state, value);
+        } else if (nextTimeout < 0 || remaining < nextTimeout) {
+            nextTimeout = static_cast<int>(remaining);
+        }
+    }
+
+    if (nextTimeout >= 0) {
+        m_timer.start(nextTimeout);
+    }
+}
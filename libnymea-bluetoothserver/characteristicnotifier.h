@@ -0,0 +1,91 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef CHARACTERISTICNOTIFIER_H
+#define CHARACTERISTICNOTIFIER_H
+
+#include <QHash>
+#include <QTimer>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QBluetoothUuid>
+#include <QLowEnergyService>
+
+#include "bluetoothsession.h"
+
+// Writes state characteristics of a service with a minimum interval between two notifications of the
+// same characteristic. Values changing faster will be conflated, only the newest one will be sent.
+class CharacteristicNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CharacteristicNotifier(QLowEnergyService *service, QObject *parent = nullptr);
+
+    // Minimum time in ms between two notifications of a characteristic, 0 writes each value right away
+    int minimumInterval() const;
+    void setMinimumInterval(int minimumInterval);
+
+    // Characteristics without notifications enabled by the client of the session will still be updated
+    // for reading, but immediately since there is nothing to conflate.
+    BluetoothSession *session() const;
+    void setSession(BluetoothSession *session);
+
+    // Number of values which have been replaced by a newer one before being sent
+    int conflatedCount() const;
+
+    void notify(const QBluetoothUuid &characteristicUuid, const QByteArray &value);
+
+private:
+    class CharacteristicState
+    {
+    public:
+        QByteArray lastValue;
+        QByteArray pendingValue;
+        bool pending = false;
+        QElapsedTimer lastWriteTimer;
+    };
+
+    QPointer<QLowEnergyService> m_service;
+    QPointer<BluetoothSession> m_session;
+    int m_minimumInterval = 200;
+    int m_conflatedCount = 0;
+
+    QHash<QBluetoothUuid, CharacteristicState> m_characteristics;
+    QTimer m_timer;
+
+    void write(const QBluetoothUuid &characteristicUuid, CharacteristicState &state, const QByteArray &value);
+
+private slots:
+    void onTimeout();
+
+};
+
+#endif // CHARACTERISTICNOTIFIER_H
@@ -0,0 +1,187 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "connectionparameterpolicy.h"
+#include "loggingcategories.h"
+
+#include <QElapsedTimer>
+
+ConnectionParameterPolicy::ConnectionParameterPolicy(QObject *parent) : QObject(parent)
+{
+    // Note: the defaults follow the accessory guidelines of the common mobile platforms
+    m_fastParameters.setIntervalRange(15, 30);
+    m_fastParameters.setLatency(0);
+    m_fastParameters.setSupervisionTimeout(4000);
+
+    m_relaxedParameters.setIntervalRange(200, 400);
+    m_relaxedParameters.setLatency(0);
+    m_relaxedParameters.setSupervisionTimeout(6000);
+
+    m_clock = [](){
+        QElapsedTimer timer;
+        timer.start();
+        return timer.msecsSinceReference();
+    };
+
+    m_updateTimer.setSingleShot(true);
+    connect(&m_updateTimer, &QTimer::timeout, this, &ConnectionParameterPolicy::update);
+}
+
+bool ConnectionParameterPolicy::enabled() const
+{
+    return m_enabled;
+}
+
+void ConnectionParameterPolicy::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!m_enabled) {
+        stop();
+    }
+}
+
+QLowEnergyConnectionParameters ConnectionParameterPolicy::fastParameters() const
+{
+    return m_fastParameters;
+}
+
+void ConnectionParameterPolicy::setFastParameters(const QLowEnergyConnectionParameters &fastParameters)
+{
+    m_fastParameters = fastParameters;
+}
+
+QLowEnergyConnectionParameters ConnectionParameterPolicy::relaxedParameters() const
+{
+    return m_relaxedParameters;
+}
+
+void ConnectionParameterPolicy::setRelaxedParameters(const QLowEnergyConnectionParameters &relaxedParameters)
+{
+    m_relaxedParameters = relaxedParameters;
+}
+
+int ConnectionParameterPolicy::idleTimeout() const
+{
+    return m_idleTimeout;
+}
+
+void ConnectionParameterPolicy::setIdleTimeout(int idleTimeout)
+{
+    m_idleTimeout = idleTimeout;
+}
+
+int ConnectionParameterPolicy::holdTime() const
+{
+    return m_holdTime;
+}
+
+void ConnectionParameterPolicy::setHoldTime(int holdTime)
+{
+    m_holdTime = holdTime;
+}
+
+ConnectionParameterPolicy::Mode ConnectionParameterPolicy::mode() const
+{
+    return m_mode;
+}
+
+void ConnectionParameterPolicy::setClock(Clock clock)
+{
+    m_clock = clock;
+}
+
+void ConnectionParameterPolicy::requestMode(Mode mode, qint64 now)
+{
+    m_mode = mode;
+    m_lastRequest = now;
+
+    QLowEnergyConnectionParameters parameters = (m_mode == ModeFast ? m_fastParameters : m_relaxedParameters);
+    qCDebug(dcNymeaBluetoothServer()) << "Request connection parameters" << m_mode << "interval" << parameters.minimumInterval() << "-" << parameters.maximumInterval() << "ms, latency" << parameters.latency() << "supervision timeout" << parameters.supervisionTimeout() << "ms";
+    emit modeChanged(m_mode);
+    emit connectionUpdateRequested(parameters);
+}
+
+void ConnectionParameterPolicy::start()
+{
+    if (!m_enabled)
+        return;
+
+    m_active = true;
+    m_mode = ModeNone;
+    m_lastRequest = -1;
+    notifyActivity();
+}
+
+void ConnectionParameterPolicy::stop()
+{
+    m_active = false;
+    m_updateTimer.stop();
+    m_lastRequest = -1;
+    m_mode = ModeNone;
+}
+
+void ConnectionParameterPolicy::notifyActivity()
+{
+    if (!m_active)
+        return;
+
+    m_lastActivity = m_clock();
+    update();
+}
+
+void ConnectionParameterPolicy::update()
+{
+    m_updateTimer.stop();
+    if (!m_active)
+        return;
+
+    qint64 now = m_clock();
+    qint64 idleDuration = now - m_lastActivity;
+    Mode mode = idleDuration >= m_idleTimeout ? ModeRelaxed : ModeFast;
+
+    // Time in ms until the policy has to be evaluated again, -1 if nothing will change without activity
+    qint64 nextUpdate = -1;
+    if (mode == ModeFast)
+        nextUpdate = m_idleTimeout - idleDuration;
+
+    if (mode != m_mode) {
+        // Hysteresis: wait until the previous request is old enough
+        qint64 holdRemaining = m_lastRequest < 0 ? 0 : m_holdTime - (now - m_lastRequest);
+        if (holdRemaining > 0) {
+            nextUpdate = nextUpdate < 0 ? holdRemaining : qMin(nextUpdate, holdRemaining);
+        } else {
+            requestMode(mode, now);
+        }
+    }
+
+    if (nextUpdate >= 0) {
+        m_updateTimer.start(static_cast<int>(nextUpdate));
+    }
+}
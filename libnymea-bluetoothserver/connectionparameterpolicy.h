@@ -0,0 +1,114 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef CONNECTIONPARAMETERPOLICY_H
+#define CONNECTIONPARAMETERPOLICY_H
+
+#include <QTimer>
+#include <QObject>
+#include <QLowEnergyConnectionParameters>
+
+#include <functional>
+
+// Decides which connection parameters should be requested for the current traffic. Requests a short
+// connection interval while data is moving and a relaxed interval once the connection has been idle.
+// The policy does not know the controller, it only emits the parameters to request.
+class ConnectionParameterPolicy : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode {
+        ModeNone,
+        ModeFast,
+        ModeRelaxed
+    };
+    Q_ENUM(Mode)
+
+    explicit ConnectionParameterPolicy(QObject *parent = nullptr);
+
+    bool enabled() const;
+    void setEnabled(bool enabled);
+
+    QLowEnergyConnectionParameters fastParameters() const;
+    void setFastParameters(const QLowEnergyConnectionParameters &fastParameters);
+
+    QLowEnergyConnectionParameters relaxedParameters() const;
+    void setRelaxedParameters(const QLowEnergyConnectionParameters &relaxedParameters);
+
+    // Time in ms without traffic until the relaxed parameters will be requested
+    int idleTimeout() const;
+    void setIdleTimeout(int idleTimeout);
+
+    // Minimum time in ms between two requests, avoids flapping between the modes
+    int holdTime() const;
+    void setHoldTime(int holdTime);
+
+    Mode mode() const;
+
+    // Monotonic time in ms used for all decisions, the steady clock by default. Tests can replace it.
+    typedef std::function<qint64()> Clock;
+    void setClock(Clock clock);
+
+private:
+    bool m_enabled = false;
+    bool m_active = false;
+    Mode m_mode = ModeNone;
+
+    QLowEnergyConnectionParameters m_fastParameters;
+    QLowEnergyConnectionParameters m_relaxedParameters;
+    int m_idleTimeout = 5000;
+    int m_holdTime = 2000;
+
+    Clock m_clock;
+    qint64 m_lastActivity = 0;
+    qint64 m_lastRequest = -1;
+    QTimer m_updateTimer;
+
+    void requestMode(Mode mode, qint64 now);
+
+signals:
+    void modeChanged(Mode mode);
+    void connectionUpdateRequested(const QLowEnergyConnectionParameters &parameters);
+
+public slots:
+    // A client connected, the handshake will follow so the fast parameters will be requested
+    void start();
+    void stop();
+
+    // Data has been sent or received
+    void notifyActivity();
+
+    // Requests the parameters for the current traffic if the hold time allows it. Called by the
+    // internal timer once the connection became idle or the hold time of a pending change passed.
+    void update();
+
+};
+
+#endif // CONNECTIONPARAMETERPOLICY_H
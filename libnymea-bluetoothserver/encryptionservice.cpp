@@ -31,18 +31,16 @@
 #include "encryptionservice.h"
 #include "loggingcategories.h"
 
-#include <QMetaEnum>
-#include <QJsonDocument>
-#include <QJsonParseError>
 #include <QCryptographicHash>
 #include <QLowEnergyDescriptorData>
 #include <QLowEnergyCharacteristicData>
 
-EncryptionService::EncryptionService(EncryptionHandler *encryptionHandler, QObject *parent) :
-    BluetoothService(parent),
-    m_encryptionHandler(encryptionHandler)
+EncryptionService::EncryptionService(QObject *parent) :
+    BluetoothService(parent)
 {
-
+    registerMethod(MethodInitiateEncryption, {{"pk", QJsonValue::String}}, [this](const QJsonObject &params) { initiateEncryption(params); });
+    registerMethod(MethodConfirmChallenge, {{"n", QJsonValue::String}, {"c", QJsonValue::String}}, [this](const QJsonObject &params) { confirmChallenge(params); });
+    registerMethod(MethodHeartbeat, {}, [this](const QJsonObject &params) { heartbeat(params); });
 }
 
 EncryptionService::~EncryptionService()
@@ -57,17 +55,20 @@ QString EncryptionService::name() const
 
 QBluetoothUuid EncryptionService::serviceUuid() const
 {
-    return QBluetoothUuid(QUuid("56c8ae10-def5-4d9c-8233-795a32d01cd2"));
+    static const QBluetoothUuid uuid(QUuid("56c8ae10-def5-4d9c-8233-795a32d01cd2"));
+    return uuid;
 }
 
 QBluetoothUuid EncryptionService::receiverCharacteristicUuid() const
 {
-    return QBluetoothUuid(QUuid("56c8ae11-def5-4d9c-8233-795a32d01cd2"));
+    static const QBluetoothUuid uuid(QUuid("56c8ae11-def5-4d9c-8233-795a32d01cd2"));
+    return uuid;
 }
 
 QBluetoothUuid EncryptionService::senderCharacteristicUuid() const
 {
-    return QBluetoothUuid(QUuid("56c8ae12-def5-4d9c-8233-795a32d01cd2"));
+    static const QBluetoothUuid uuid(QUuid("56c8ae12-def5-4d9c-8233-795a32d01cd2"));
+    return uuid;
 }
 
 bool EncryptionService::useEncryption() const
@@ -75,118 +76,90 @@ bool EncryptionService::useEncryption() const
     return false;
 }
 
-void EncryptionService::receiveData(const QByteArray &data)
+EncryptionHandler *EncryptionService::sessionEncryptionHandler() const
 {
-    qCDebug(dcNymeaBluetoothServer()) << name() << "message received" << qUtf8Printable(data);
-
-    QJsonParseError jsonError;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &jsonError);
-    if (jsonError.error != QJsonParseError::NoError) {
-        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "received invalid json data" << jsonError.errorString() << qUtf8Printable(data);
-        sendResponse(MethodUnknown, ResponseCodeInvalidProtocol);
-        return;
-    }
+    if (!session())
+        return nullptr;
 
-    QVariantMap requestData = jsonDoc.toVariant().toMap();
+    return session()->encryptionHandler();
+}
 
-    if (!requestData.contains("c")) {
-        qCWarning(dcNymeaBluetoothServerTraffic()) << name() << "received invalid request data. The method property \"c\" is not included" << requestData;
-        sendResponse(MethodUnknown, ResponseCodeInvalidProtocol);
+void EncryptionService::initiateEncryption(const QJsonObject &params)
+{
+    EncryptionHandler *encryptionHandler = sessionEncryptionHandler();
+    if (!encryptionHandler) {
+        qCWarning(dcNymeaBluetoothServer()) << "Initiate encryption called without a client session.";
+        sendResponse(MethodInitiateEncryption, ResponseCodeEncryptionFailed);
         return;
     }
 
-    int methodInt = requestData.value("c").toInt();
-    bool methodIntValid = false;
-    QMetaEnum methodEnum = QMetaEnum::fromType<Method>();
-    for (int i = 0; i < methodEnum.keyCount(); i++) {
-        if (methodEnum.value(i) == methodInt) {
-            methodIntValid = true;
-            break;
-        }
-    }
-
-    if (!methodIntValid) {
-        qCWarning(dcNymeaBluetoothServerTraffic()) << "Invalid method received. There is no method/command with id" << methodInt;
-        sendResponse(methodInt, ResponseCodeInvalidMethod);
+    QString clientPublicKeyString = params.value("pk").toString();
+    QByteArray clientPublicKey = QByteArray::fromHex(clientPublicKeyString.toUtf8());
+    qCDebug(dcNymeaBluetoothServer()) << "Received client public key" << clientPublicKey.toHex();
+    if (!encryptionHandler->calculateSharedKey(clientPublicKey)) {
+        qCWarning(dcNymeaBluetoothServerTraffic()) << "Failed to create shared key for client public key" << clientPublicKey.toHex();
+        sendResponse(MethodInitiateEncryption, ResponseCodeEncryptionFailed);
         return;
     }
 
-    QVariantMap params;
-    if (requestData.contains("p")) {
-        params = requestData.value("p").toMap();
+    // Encrypt challenge
+    QByteArray nonce = encryptionHandler->generateNonce();
+    QByteArray encryptedChallenge = encryptionHandler->encryptData(encryptionHandler->generateChallenge(), nonce);
+
+    // Create response parameters
+    JsonWriter responseParams;
+    responseParams.beginObject();
+    responseParams.writeKey("pk");
+    responseParams.writeValue(QString::fromLatin1(encryptionHandler->publicKey().toHex()));
+    responseParams.writeKey("n");
+    responseParams.writeValue(QString::fromLatin1(nonce.toHex()));
+    responseParams.writeKey("c");
+    responseParams.writeValue(QString::fromLatin1(encryptedChallenge.toHex()));
+
+    // Enable the key ratchet only if the client supports it and the server has limits configured
+    bool rekeying = params.value("rk").toBool(false) && (encryptionHandler->rekeyMessageLimit() > 0 || encryptionHandler->rekeyByteLimit() > 0);
+    encryptionHandler->setRekeyingEnabled(rekeying);
+    if (rekeying) {
+        qCDebug(dcNymeaBluetoothServer()) << "Rekeying enabled for this session. Message limit:" << encryptionHandler->rekeyMessageLimit() << "Byte limit:" << encryptionHandler->rekeyByteLimit();
+        responseParams.writeKey("rm");
+        responseParams.writeValue(encryptionHandler->rekeyMessageLimit());
+        responseParams.writeKey("rb");
+        responseParams.writeValue(encryptionHandler->rekeyByteLimit());
     }
+    responseParams.endObject();
 
-    processRequest(static_cast<Method>(methodInt), params);
+    sendResponse(MethodInitiateEncryption, ResponseCodeSuccess, responseParams);
 }
 
-void EncryptionService::processRequest(EncryptionService::Method method, const QVariantMap &params)
+void EncryptionService::confirmChallenge(const QJsonObject &params)
 {
-    switch (method) {
-    case MethodUnknown:
-        qCWarning(dcNymeaBluetoothServerTraffic()) << "The method unknown is forbidden. It will only be used if the protocol is violated and the method unknown fot the response.";
-        break;
-    case MethodInitiateEncryption: {
-        if (params.isEmpty() || !params.contains("pk")) {
-            qCWarning(dcNymeaBluetoothServerTraffic()) << "Invalid params for" << method << params << "The public key from the client is missing";
-            sendResponse(method, ResponseCodeInvalidParams);
-            return;
-        }
-
-        QString clientPublicKeyString = params.value("pk").toString();
-        QByteArray clientPublicKey = QByteArray::fromHex(clientPublicKeyString.toUtf8());
-        qCDebug(dcNymeaBluetoothServer()) << "Received client public key" << clientPublicKey.toHex();
-        if (!m_encryptionHandler->calculateSharedKey(clientPublicKey)) {
-            qCWarning(dcNymeaBluetoothServerTraffic()) << "Failed to create shared key for client public key" << clientPublicKey.toHex();
-            sendResponse(method, ResponseCodeEncryptionFailed);
-            return;
-        }
-
-        // Encrypt challenge
-        QByteArray nonce = m_encryptionHandler->generateNonce();
-        QByteArray encryptedChallenge = m_encryptionHandler->encryptData(m_encryptionHandler->generateChallenge(), nonce);
-
-        // Create response parameters
-        QVariantMap responseParams;
-        responseParams.insert("pk", m_encryptionHandler->publicKey().toHex());
-        responseParams.insert("n", nonce.toHex());
-        responseParams.insert("c", encryptedChallenge.toHex());
-        sendResponse(method, ResponseCodeSuccess, responseParams);
-        break;
-    }
-    case MethodConfirmChallenge: {
-        if (params.isEmpty() || !params.contains("n") || !params.contains("c")) {
-            qCWarning(dcNymeaBluetoothServerTraffic()) << "Invalid params for" << method << params;
-            sendResponse(method, ResponseCodeInvalidParams);
-            return;
-        }
-
-        QByteArray nonce = QByteArray::fromHex(params.value("n").toString().toUtf8());
-        QByteArray encryptedChallengeConfirmation = QByteArray::fromHex(params.value("c").toString().toUtf8());
-
-        // Decrypt the message
-        QByteArray challengeConfirmation = m_encryptionHandler->decryptData(encryptedChallengeConfirmation, nonce);
-        if (!m_encryptionHandler->verifyChallenge(challengeConfirmation)) {
-            qCWarning(dcNymeaBluetoothEncryption()) << "Challenge confirmation does not match the expected value.";
-            sendResponse(method, ResponseCodeEncryptionFailed);
-            return;
-        }
-
-        qCDebug(dcNymeaBluetoothServer()) << "Encryption established successfully";
-        sendResponse(method, ResponseCodeSuccess);
-        break;
+    EncryptionHandler *encryptionHandler = sessionEncryptionHandler();
+    if (!encryptionHandler) {
+        qCWarning(dcNymeaBluetoothServer()) << "Confirm challenge called without a client session.";
+        sendResponse(MethodConfirmChallenge, ResponseCodeEncryptionFailed);
+        return;
     }
+
+    QByteArray nonce = QByteArray::fromHex(params.value("n").toString().toUtf8());
+    QByteArray encryptedChallengeConfirmation = QByteArray::fromHex(params.value("c").toString().toUtf8());
+
+    // Decrypt the message
+    QByteArray challengeConfirmation = encryptionHandler->decryptData(encryptedChallengeConfirmation, nonce);
+    if (!encryptionHandler->verifyChallenge(challengeConfirmation)) {
+        qCWarning(dcNymeaBluetoothEncryption()) << "Challenge confirmation does not match the expected value.";
+        sendResponse(MethodConfirmChallenge, ResponseCodeEncryptionFailed);
+        return;
     }
+
+    qCDebug(dcNymeaBluetoothServer()) << "Encryption established successfully";
+    sendResponse(MethodConfirmChallenge, ResponseCodeSuccess);
 }
 
-void EncryptionService::sendResponse(int method, EncryptionService::ResponseCode responseCode, const QVariantMap &responseParams)
+void EncryptionService::heartbeat(const QJsonObject &params)
 {
-    QVariantMap response;
-    response.insert("c", method);
-    response.insert("r", static_cast<int>(responseCode));
-    if (!responseParams.isEmpty()) {
-        response.insert("p", responseParams);
-    }
+    Q_UNUSED(params)
 
-    QByteArray data = QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact);
-    sendData(data);
+    // Note: the request itself keeps the session alive, see BluetoothServer::sessionIdleTimeout()
+    qCDebug(dcNymeaBluetoothServerTraffic()) << "Heartbeat received";
+    sendResponse(MethodHeartbeat, ResponseCodeSuccess);
 }
@@ -35,6 +35,7 @@
 #include <QLowEnergyService>
 
 #include "bluetoothservice.h"
+#include "bluetoothsession.h"
 #include "encryptionhandler.h"
 
 class EncryptionService : public BluetoothService
@@ -44,22 +45,23 @@ public:
     enum Method {
         MethodUnknown = -1,
         MethodInitiateEncryption = 0,
-        MethodConfirmChallenge = 1
+        MethodConfirmChallenge = 1,
+        MethodHeartbeat = 2
     };
     Q_ENUM(Method)
 
     enum ResponseCode {
-        ResponseCodeSuccess = 0,
-        ResponseCodeInvalidProtocol = 1,
-        ResponseCodeInvalidMethod = 2,
-        ResponseCodeInvalidParams = 3,
-        ResponseCodeInvalidKeyFormat = 4,
+        ResponseCodeSuccess = BluetoothService::ResponseCodeSuccess,
+        ResponseCodeInvalidProtocol = BluetoothService::ResponseCodeInvalidProtocol,
+        ResponseCodeInvalidMethod = BluetoothService::ResponseCodeInvalidMethod,
+        ResponseCodeInvalidParams = BluetoothService::ResponseCodeInvalidParams,
+        ResponseCodeInvalidKeyFormat = BluetoothService::ResponseCodeCustom,
         ResponseCodeAlreadyEncrypted = 5,
         ResponseCodeEncryptionFailed = 6
     };
     Q_ENUM(ResponseCode)
 
-    explicit EncryptionService(EncryptionHandler *encryptionHandler, QObject *parent = nullptr);
+    explicit EncryptionService(QObject *parent = nullptr);
     ~EncryptionService() override;
 
     QString name() const override;
@@ -68,16 +70,14 @@ public:
     QBluetoothUuid senderCharacteristicUuid() const override;
     bool useEncryption() const override;
 
-public slots:
-    void receiveData(const QByteArray &data) override;
-
 private:
-    EncryptionHandler *m_encryptionHandler = nullptr;
-
-    void processRequest(Method method, const QVariantMap &params = QVariantMap());
-    void sendResponse(int method, ResponseCode responseCode = ResponseCodeSuccess, const QVariantMap &responseParams = QVariantMap());
-
+    // The encryption handler of the current session
+    EncryptionHandler *sessionEncryptionHandler() const;
 
+    // Methods
+    void initiateEncryption(const QJsonObject &params);
+    void confirmChallenge(const QJsonObject &params);
+    void heartbeat(const QJsonObject &params);
 
 };
 
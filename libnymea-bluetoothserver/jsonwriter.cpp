@@ -0,0 +1,187 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "jsonwriter.h"
+
+JsonWriter::JsonWriter(int reserve)
+{
+    if (reserve > 0)
+        m_data.reserve(reserve);
+}
+
+void JsonWriter::beginObject()
+{
+    beginValue();
+    m_data.append('{');
+    m_scopeHasValues.append(false);
+}
+
+void JsonWriter::endObject()
+{
+    Q_ASSERT_X(!m_scopeHasValues.isEmpty(), "JsonWriter", "end object without begin.");
+    m_scopeHasValues.removeLast();
+    m_data.append('}');
+}
+
+void JsonWriter::beginArray()
+{
+    beginValue();
+    m_data.append('[');
+    m_scopeHasValues.append(false);
+}
+
+void JsonWriter::endArray()
+{
+    Q_ASSERT_X(!m_scopeHasValues.isEmpty(), "JsonWriter", "end array without begin.");
+    m_scopeHasValues.removeLast();
+    m_data.append(']');
+}
+
+void JsonWriter::writeKey(const char *key)
+{
+    Q_ASSERT_X(!m_scopeHasValues.isEmpty() && !m_keyWritten, "JsonWriter", "key written outside of an object.");
+    if (m_scopeHasValues.last())
+        m_data.append(',');
+
+    m_scopeHasValues.last() = true;
+    m_data.append('"');
+    m_data.append(key);
+    m_data.append("\":");
+    m_keyWritten = true;
+}
+
+void JsonWriter::writeValue(int value)
+{
+    beginValue();
+    m_data.append(QByteArray::number(value));
+}
+
+void JsonWriter::writeValue(qint64 value)
+{
+    beginValue();
+    m_data.append(QByteArray::number(value));
+}
+
+void JsonWriter::writeValue(bool value)
+{
+    beginValue();
+    m_data.append(value ? "true" : "false");
+}
+
+void JsonWriter::writeValue(const char *value)
+{
+    beginValue();
+    appendString(QByteArray(value));
+}
+
+void JsonWriter::writeValue(const QString &value)
+{
+    beginValue();
+    appendString(value.toUtf8());
+}
+
+void JsonWriter::writeNull()
+{
+    beginValue();
+    m_data.append("null");
+}
+
+void JsonWriter::writeRawValue(const QByteArray &json)
+{
+    beginValue();
+    m_data.append(json);
+}
+
+bool JsonWriter::isEmpty() const
+{
+    return m_data.isEmpty();
+}
+
+QByteArray JsonWriter::data() const
+{
+    return m_data;
+}
+
+void JsonWriter::beginValue()
+{
+    // Values of an object have been prefixed by the key
+    if (m_keyWritten) {
+        m_keyWritten = false;
+        return;
+    }
+
+    // Array values
+    if (!m_scopeHasValues.isEmpty()) {
+        if (m_scopeHasValues.last())
+            m_data.append(',');
+
+        m_scopeHasValues.last() = true;
+    }
+}
+
+void JsonWriter::appendString(const QByteArray &utf8)
+{
+    m_data.append('"');
+    for (int i = 0; i < utf8.length(); i++) {
+        char character = utf8.at(i);
+        switch (character) {
+        case '"':
+            m_data.append("\\\"");
+            break;
+        case '\\':
+            m_data.append("\\\\");
+            break;
+        case '\b':
+            m_data.append("\\b");
+            break;
+        case '\f':
+            m_data.append("\\f");
+            break;
+        case '\n':
+            m_data.append("\\n");
+            break;
+        case '\r':
+            m_data.append("\\r");
+            break;
+        case '\t':
+            m_data.append("\\t");
+            break;
+        default:
+            if (static_cast<quint8>(character) < 0x20) {
+                m_data.append("\\u00");
+                m_data.append(QByteArray::number(static_cast<quint8>(character), 16).rightJustified(2, '0'));
+            } else {
+                m_data.append(character);
+            }
+            break;
+        }
+    }
+    m_data.append('"');
+}
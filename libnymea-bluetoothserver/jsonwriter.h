@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QVector>
+#include <QString>
+#include <QByteArray>
+
+// Writes compact JSON directly into a byte array without building a QVariant tree first
+class JsonWriter
+{
+public:
+    explicit JsonWriter(int reserve = 0);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // Note: the key will be written as it is and must not contain characters which need to be escaped
+    void writeKey(const char *key);
+
+    void writeValue(int value);
+    void writeValue(qint64 value);
+    void writeValue(bool value);
+    void writeValue(const char *value);
+    void writeValue(const QString &value);
+    void writeNull();
+
+    // Writes an already serialized JSON value
+    void writeRawValue(const QByteArray &json);
+
+    bool isEmpty() const;
+    QByteArray data() const;
+
+private:
+    QByteArray m_data;
+    QVector<bool> m_scopeHasValues;
+    bool m_keyWritten = false;
+
+    void beginValue();
+    void appendString(const QByteArray &utf8);
+
+};
+
+#endif // JSONWRITER_H
@@ -15,23 +15,40 @@ DEFINES += VERSION_STRING=\\\"$${VERSION_STRING}\\\"
 
 SOURCES += \
     bluetoothserver.cpp \
+    bluetoothservice.cpp \
     bluetoothservicedatahandler.cpp \
+    bluetoothsession.cpp \
+    characteristicnotifier.cpp \
+    connectionparameterpolicy.cpp \
     encryptionhandler.cpp \
     encryptionservice.cpp \
+    jsonwriter.cpp \
+    linksecurityprovider.cpp \
     loggingcategories.cpp \
+    networkmanager/accesspointfilter.cpp \
+    networkmanager/interfaceaddresscache.cpp \
     networkmanager/networkmanagerservice.cpp \
     networkmanager/networkservice.cpp \
+    networkmanager/wirelessscanmanager.cpp \
     networkmanager/wirelessservice.cpp
 
 HEADERS += \
     bluetoothserver.h \
     bluetoothservice.h \
     bluetoothservicedatahandler.h \
+    bluetoothsession.h \
+    characteristicnotifier.h \
+    connectionparameterpolicy.h \
     encryptionhandler.h \
     encryptionservice.h \
+    jsonwriter.h \
+    linksecurityprovider.h \
     loggingcategories.h \
+    networkmanager/accesspointfilter.h \
+    networkmanager/interfaceaddresscache.h \
     networkmanager/networkmanagerservice.h \
     networkmanager/networkservice.h \
+    networkmanager/wirelessscanmanager.h \
     networkmanager/wirelessservice.h
 
 target.path = $$[QT_INSTALL_LIBS]
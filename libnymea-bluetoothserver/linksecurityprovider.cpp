@@ -0,0 +1,151 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "linksecurityprovider.h"
+#include "loggingcategories.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+// Note: the HCI socket interface of the kernel (see bluez lib/hci.h), there is no kernel header exporting it
+namespace {
+
+const int btProtoHci = 1;
+const unsigned short hciChannelRaw = 0;
+const quint8 hciLeLink = 0x80;
+const quint32 hciLinkModeAuth = 0x0002;
+const quint32 hciLinkModeEncrypt = 0x0004;
+const quint32 hciLinkModeFips = 0x0040; // LE Secure Connections key
+const int hciMaxDevices = 16;
+
+struct HciBdAddress {
+    quint8 b[6];
+} __attribute__((packed));
+
+struct HciSocketAddress {
+    sa_family_t family;
+    unsigned short dev;
+    unsigned short channel;
+};
+
+struct HciDevRequest {
+    quint16 devId;
+    quint32 devOption;
+};
+
+struct HciDevListRequest {
+    quint16 devNumber;
+    HciDevRequest devRequests[hciMaxDevices];
+};
+
+struct HciConnInfo {
+    quint16 handle;
+    HciBdAddress address;
+    quint8 type;
+    quint8 out;
+    quint16 state;
+    quint32 linkMode;
+};
+
+struct HciConnInfoRequest {
+    HciBdAddress address;
+    quint8 type;
+    HciConnInfo connInfo[1];
+};
+
+const unsigned long hciGetDevList = _IOR('H', 210, int);
+const unsigned long hciGetConnInfo = _IOR('H', 213, int);
+
+}
+
+HciLinkSecurityProvider::HciLinkSecurityProvider(QObject *parent) :
+    LinkSecurityProvider(parent)
+{
+
+}
+
+LinkSecurityProvider::LinkSecurity HciLinkSecurityProvider::linkSecurity(const QBluetoothAddress &remoteAddress) const
+{
+    int listSocket = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, btProtoHci);
+    if (listSocket < 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not open HCI socket for reading the link security:" << strerror(errno);
+        return LinkSecurityNone;
+    }
+
+    HciDevListRequest devListRequest = {};
+    devListRequest.devNumber = hciMaxDevices;
+    int result = ioctl(listSocket, hciGetDevList, &devListRequest);
+    close(listSocket);
+    if (result < 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not read the HCI device list:" << strerror(errno);
+        return LinkSecurityNone;
+    }
+
+    // Note: the address is stored in reversed byte order
+    HciConnInfoRequest connInfoRequest = {};
+    quint64 address = remoteAddress.toUInt64();
+    for (int i = 0; i < 6; i++)
+        connInfoRequest.address.b[i] = static_cast<quint8>(address >> (8 * i));
+
+    // The connection belongs to one of the adapters
+    for (int i = 0; i < qMin(static_cast<int>(devListRequest.devNumber), hciMaxDevices); i++) {
+        int devSocket = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, btProtoHci);
+        if (devSocket < 0)
+            continue;
+
+        HciSocketAddress socketAddress = {};
+        socketAddress.family = AF_BLUETOOTH;
+        socketAddress.dev = devListRequest.devRequests[i].devId;
+        socketAddress.channel = hciChannelRaw;
+        connInfoRequest.type = hciLeLink;
+        result = -1;
+        if (bind(devSocket, reinterpret_cast<struct sockaddr *>(&socketAddress), sizeof(socketAddress)) == 0)
+            result = ioctl(devSocket, hciGetConnInfo, &connInfoRequest);
+
+        close(devSocket);
+        if (result < 0)
+            continue;
+
+        quint32 linkMode = connInfoRequest.connInfo[0].linkMode;
+        if ((linkMode & hciLinkModeEncrypt) && (linkMode & hciLinkModeAuth) && (linkMode & hciLinkModeFips))
+            return LinkSecurityAuthenticated;
+
+        if (linkMode & hciLinkModeEncrypt)
+            return LinkSecurityEncrypted;
+
+        return LinkSecurityNone;
+    }
+
+    qCDebug(dcNymeaBluetoothServer()) << "Could not find the LE connection to" << remoteAddress.toString();
+    return LinkSecurityNone;
+}
@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef LINKSECURITYPROVIDER_H
+#define LINKSECURITYPROVIDER_H
+
+#include <QObject>
+#include <QBluetoothAddress>
+
+class LinkSecurityProvider : public QObject
+{
+    Q_OBJECT
+public:
+    enum LinkSecurity {
+        LinkSecurityNone,
+        LinkSecurityEncrypted,
+        LinkSecurityAuthenticated
+    };
+    Q_ENUM(LinkSecurity)
+
+    explicit LinkSecurityProvider(QObject *parent = nullptr) : QObject(parent) { };
+    virtual ~LinkSecurityProvider() = default;
+
+    // Returns the current security of the bluetooth link to the given remote device.
+    // LinkSecurityAuthenticated means the link is encrypted using an authenticated LE Secure Connections key.
+    virtual LinkSecurity linkSecurity(const QBluetoothAddress &remoteAddress) const = 0;
+
+};
+
+// Reads the link mode of the LE connection to the remote device from the kernel (HCIGETCONNINFO)
+class HciLinkSecurityProvider : public LinkSecurityProvider
+{
+    Q_OBJECT
+public:
+    explicit HciLinkSecurityProvider(QObject *parent = nullptr);
+
+    LinkSecurity linkSecurity(const QBluetoothAddress &remoteAddress) const override;
+
+};
+
+#endif // LINKSECURITYPROVIDER_H
@@ -0,0 +1,108 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "accesspointfilter.h"
+
+#include <QHash>
+#include <QPair>
+
+#include <algorithm>
+
+bool AccessPointFilter::isEmpty() const
+{
+    return minimumSignalStrength <= 0 && !deduplicate && sortOrder == SortOrderNone && maximumCount <= 0;
+}
+
+AccessPointFilter AccessPointFilter::fromParams(const QJsonObject &params)
+{
+    AccessPointFilter filter;
+    filter.minimumSignalStrength = params.value("s").toInt(0);
+    filter.deduplicate = params.value("d").toBool(false);
+    filter.maximumCount = qMax(0, params.value("n").toInt(0));
+
+    int sortOrder = params.value("o").toInt(SortOrderNone);
+    if (sortOrder == SortOrderSignalStrength || sortOrder == SortOrderSsid)
+        filter.sortOrder = static_cast<SortOrder>(sortOrder);
+
+    return filter;
+}
+
+QList<WirelessAccessPoint *> AccessPointFilter::apply(const QList<WirelessAccessPoint *> &accessPoints) const
+{
+    if (isEmpty())
+        return accessPoints;
+
+    QList<WirelessAccessPoint *> result;
+    result.reserve(accessPoints.count());
+
+    // Index of each network in the result, used to keep only the strongest access point of a network.
+    // An open and a protected network with the same SSID are different networks.
+    QHash<QPair<QString, bool>, int> networkIndex;
+    foreach (WirelessAccessPoint *accessPoint, accessPoints) {
+        if (static_cast<int>(accessPoint->signalStrength()) < minimumSignalStrength)
+            continue;
+
+        // Note: hidden networks have no SSID and will never be merged
+        if (deduplicate && !accessPoint->ssid().isEmpty()) {
+            QPair<QString, bool> network(accessPoint->ssid(), accessPoint->isProtected());
+            QHash<QPair<QString, bool>, int>::const_iterator index = networkIndex.constFind(network);
+            if (index != networkIndex.constEnd()) {
+                if (accessPoint->signalStrength() > result.at(index.value())->signalStrength())
+                    result[index.value()] = accessPoint;
+
+                continue;
+            }
+
+            networkIndex.insert(network, result.count());
+        }
+
+        result.append(accessPoint);
+    }
+
+    switch (sortOrder) {
+    case SortOrderNone:
+        break;
+    case SortOrderSignalStrength:
+        std::stable_sort(result.begin(), result.end(), [](WirelessAccessPoint *a, WirelessAccessPoint *b) {
+            return a->signalStrength() > b->signalStrength();
+        });
+        break;
+    case SortOrderSsid:
+        std::stable_sort(result.begin(), result.end(), [](WirelessAccessPoint *a, WirelessAccessPoint *b) {
+            return a->ssid().compare(b->ssid(), Qt::CaseInsensitive) < 0;
+        });
+        break;
+    }
+
+    if (maximumCount > 0 && result.count() > maximumCount)
+        result.erase(result.begin() + maximumCount, result.end());
+
+    return result;
+}
@@ -0,0 +1,286 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "interfaceaddresscache.h"
+#include "loggingcategories.h"
+
+#include <QtEndian>
+#include <QNetworkInterface>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+static QHostAddress attributeAddress(unsigned char family, struct rtattr *attribute)
+{
+    if (family == AF_INET && RTA_PAYLOAD(attribute) >= 4) {
+        quint32 address;
+        memcpy(&address, RTA_DATA(attribute), sizeof(address));
+        return QHostAddress(qFromBigEndian(address));
+    }
+
+    if (family == AF_INET6 && RTA_PAYLOAD(attribute) >= 16)
+        return QHostAddress(static_cast<const quint8 *>(RTA_DATA(attribute)));
+
+    return QHostAddress();
+}
+
+InterfaceAddressCache::InterfaceAddressCache(QObject *parent) :
+    QObject(parent)
+{
+    m_socket = ::socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (m_socket < 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not open netlink socket. Interface addresses will not be cached:" << strerror(errno);
+        return;
+    }
+
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (::bind(m_socket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not bind netlink socket. Interface addresses will not be cached:" << strerror(errno);
+        ::close(m_socket);
+        m_socket = -1;
+        return;
+    }
+
+    // Note: the old style connection avoids the overload of activated() in Qt 5.15
+    m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(onNetlinkActivated()));
+
+    requestDump();
+}
+
+InterfaceAddressCache::~InterfaceAddressCache()
+{
+    if (m_socket >= 0) {
+        delete m_notifier;
+        ::close(m_socket);
+    }
+}
+
+bool InterfaceAddressCache::monitoring() const
+{
+    return m_socket >= 0;
+}
+
+QList<QNetworkAddressEntry> InterfaceAddressCache::addressEntries(const QString &interfaceName)
+{
+    if (!monitoring() || m_dumpPending)
+        return readAddressEntries(interfaceName);
+
+    return m_addressEntries.value(interfaceName);
+}
+
+QHostAddress InterfaceAddressCache::ipv4Address(const QString &interfaceName)
+{
+    foreach (const QNetworkAddressEntry &entry, addressEntries(interfaceName)) {
+        if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol) {
+            return entry.ip();
+        }
+    }
+
+    return QHostAddress();
+}
+
+int InterfaceAddressCache::refreshCount() const
+{
+    return m_refreshCount;
+}
+
+QList<QNetworkAddressEntry> InterfaceAddressCache::readAddressEntries(const QString &interfaceName)
+{
+    m_refreshCount++;
+    QNetworkInterface networkInterface = QNetworkInterface::interfaceFromName(interfaceName);
+    if (!networkInterface.isValid())
+        return QList<QNetworkAddressEntry>();
+
+    return networkInterface.addressEntries();
+}
+
+void InterfaceAddressCache::requestDump()
+{
+    // The cache will be rebuilt from the response, lookups enumerate the interfaces until it is complete
+    m_dumpPending = true;
+    m_addressEntries.clear();
+
+    struct {
+        struct nlmsghdr header;
+        struct ifaddrmsg message;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    request.header.nlmsg_type = RTM_GETADDR;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++m_dumpSequence;
+    request.message.ifa_family = AF_UNSPEC;
+
+    struct sockaddr_nl kernelAddress;
+    memset(&kernelAddress, 0, sizeof(kernelAddress));
+    kernelAddress.nl_family = AF_NETLINK;
+    if (::sendto(m_socket, &request, request.header.nlmsg_len, 0, reinterpret_cast<struct sockaddr *>(&kernelAddress), sizeof(kernelAddress)) < 0) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not request the interface addresses. Interface addresses will not be cached:" << strerror(errno);
+    }
+}
+
+bool InterfaceAddressCache::processAddressMessage(struct nlmsghdr *header)
+{
+    if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+        return false;
+
+    struct ifaddrmsg *message = static_cast<struct ifaddrmsg *>(NLMSG_DATA(header));
+    if (message->ifa_family != AF_INET && message->ifa_family != AF_INET6)
+        return false;
+
+    // Note: the name is not available any more once the interface has been removed, so it will be kept
+    int interfaceIndex = static_cast<int>(message->ifa_index);
+    QString interfaceName = m_interfaceNames.value(interfaceIndex);
+    if (interfaceName.isEmpty()) {
+        char name[IF_NAMESIZE];
+        if (!if_indextoname(message->ifa_index, name))
+            return false;
+
+        interfaceName = QString::fromLocal8Bit(name);
+        m_interfaceNames.insert(interfaceIndex, interfaceName);
+    }
+
+    QHostAddress address;
+    QHostAddress localAddress;
+    QHostAddress broadcastAddress;
+    int attributesLength = static_cast<int>(IFA_PAYLOAD(header));
+    for (struct rtattr *attribute = IFA_RTA(message); RTA_OK(attribute, attributesLength); attribute = RTA_NEXT(attribute, attributesLength)) {
+        switch (attribute->rta_type) {
+        case IFA_ADDRESS:
+            address = attributeAddress(message->ifa_family, attribute);
+            break;
+        case IFA_LOCAL:
+            localAddress = attributeAddress(message->ifa_family, attribute);
+            break;
+        case IFA_BROADCAST:
+            broadcastAddress = attributeAddress(message->ifa_family, attribute);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Note: on point to point links IFA_ADDRESS is the address of the peer and IFA_LOCAL the own one
+    QHostAddress ip = localAddress.isNull() ? address : localAddress;
+    if (ip.isNull())
+        return false;
+
+    if (message->ifa_family == AF_INET6 && message->ifa_scope == RT_SCOPE_LINK)
+        ip.setScopeId(interfaceName);
+
+    QList<QNetworkAddressEntry> &entries = m_addressEntries[interfaceName];
+    for (int i = 0; i < entries.count(); i++) {
+        if (entries.at(i).ip() == ip) {
+            entries.removeAt(i);
+            break;
+        }
+    }
+
+    if (header->nlmsg_type == RTM_NEWADDR) {
+        QNetworkAddressEntry entry;
+        entry.setIp(ip);
+        entry.setPrefixLength(message->ifa_prefixlen);
+        if (!broadcastAddress.isNull())
+            entry.setBroadcast(broadcastAddress);
+
+        entries.append(entry);
+    }
+
+    return true;
+}
+
+void InterfaceAddressCache::onNetlinkActivated()
+{
+    // Read all pending messages and apply the address changes to the cache
+    bool changed = false;
+    bool resync = false;
+    alignas(struct nlmsghdr) char buffer[32768];
+    forever {
+        ssize_t length = ::recv(m_socket, buffer, sizeof(buffer), 0);
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+
+            // Note: ENOBUFS means events got lost, the cache can not be trusted any more and will be requested again
+            if (errno == ENOBUFS) {
+                resync = true;
+                continue;
+            }
+
+            break;
+        }
+
+        if (length == 0)
+            break;
+
+        size_t offset = 0;
+        while (offset + sizeof(struct nlmsghdr) <= static_cast<size_t>(length)) {
+            struct nlmsghdr *header = reinterpret_cast<struct nlmsghdr *>(buffer + offset);
+            if (header->nlmsg_len < sizeof(struct nlmsghdr) || offset + header->nlmsg_len > static_cast<size_t>(length))
+                break;
+
+            if (header->nlmsg_type == RTM_NEWADDR || header->nlmsg_type == RTM_DELADDR) {
+                if (processAddressMessage(header)) {
+                    changed = true;
+                }
+            } else if (header->nlmsg_type == NLMSG_DONE && header->nlmsg_seq == m_dumpSequence) {
+                qCDebug(dcNymeaBluetoothServer()) << "Interface addresses loaded";
+                m_dumpPending = false;
+                changed = true;
+            } else if (header->nlmsg_type == NLMSG_ERROR && header->nlmsg_seq == m_dumpSequence) {
+                // Note: the dump stays pending, lookups keep enumerating the interfaces
+                qCWarning(dcNymeaBluetoothServer()) << "Could not load the interface addresses. Interface addresses will not be cached.";
+            }
+
+            offset += NLMSG_ALIGN(header->nlmsg_len);
+        }
+    }
+
+    if (resync) {
+        qCWarning(dcNymeaBluetoothServer()) << "Netlink address events got lost. Loading the interface addresses again.";
+        requestDump();
+        changed = true;
+    }
+
+    if (!changed)
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "Interface addresses changed";
+    emit addressesChanged();
+}
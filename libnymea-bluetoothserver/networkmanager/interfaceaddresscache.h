@@ -0,0 +1,83 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef INTERFACEADDRESSCACHE_H
+#define INTERFACEADDRESSCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QHostAddress>
+#include <QSocketNotifier>
+#include <QNetworkAddressEntry>
+
+struct nlmsghdr;
+
+// Keeps the addresses of the network interfaces, so status requests do not have to enumerate the
+// interfaces each time. The cache will be filled by an address dump of the kernel at start and kept
+// up to date using the payload of the netlink address events. If the netlink socket is not available,
+// or while the dump is pending, each lookup enumerates the interfaces like before.
+class InterfaceAddressCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit InterfaceAddressCache(QObject *parent = nullptr);
+    ~InterfaceAddressCache() override;
+
+    bool monitoring() const;
+
+    QList<QNetworkAddressEntry> addressEntries(const QString &interfaceName);
+    // The first IPv4 address of the interface, null if there is none
+    QHostAddress ipv4Address(const QString &interfaceName);
+
+    // Number of times the interfaces have been enumerated because the cache was not available
+    int refreshCount() const;
+
+signals:
+    void addressesChanged();
+
+private:
+    int m_socket = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QHash<QString, QList<QNetworkAddressEntry> > m_addressEntries;
+    QHash<int, QString> m_interfaceNames;
+    bool m_dumpPending = true;
+    quint32 m_dumpSequence = 0;
+    int m_refreshCount = 0;
+
+    void requestDump();
+    bool processAddressMessage(struct nlmsghdr *header);
+    QList<QNetworkAddressEntry> readAddressEntries(const QString &interfaceName);
+
+private slots:
+    void onNetlinkActivated();
+
+};
+
+#endif // INTERFACEADDRESSCACHE_H
@@ -30,12 +30,48 @@
 
 #include "networkmanagerservice.h"
 #include "loggingcategories.h"
+#include "wirelessservice.h"
+#include "accesspointfilter.h"
+#include "bluetoothsession.h"
 
-NetworkManagerService::NetworkManagerService(NetworkManager *networkManager, QObject *parent) :
+#include <QDateTime>
+#include <QJsonArray>
+
+NetworkManagerService::NetworkManagerService(NetworkManager *networkManager, WirelessScanManager *scanManager, InterfaceAddressCache *addressCache, QObject *parent) :
     BluetoothService(parent),
-    m_networkManager(networkManager)
+    m_networkManager(networkManager),
+    m_scanManager(scanManager),
+    m_addressCache(addressCache)
 {
+    m_generation = QDateTime::currentMSecsSinceEpoch();
+    m_oldestGeneration = m_generation;
+
+    registerMethod(MethodGetNetworks, {}, [this](const QJsonObject &params) { getNetworks(params); });
+    registerMethod(MethodConnect, {{"e", QJsonValue::String}, {"p", QJsonValue::String}}, [this](const QJsonObject &params) { connectNetwork(params); });
+    registerMethod(MethodDisconnect, {}, [this](const QJsonObject &params) { disconnectNetwork(params); });
+    registerMethod(MethodScan, {}, [this](const QJsonObject &params) { scan(params); });
+    registerMethod(MethodGetCurrentConnection, {}, [this](const QJsonObject &params) { getCurrentConnection(params); });
+    registerMethod(MethodStartAccessPoint, {{"e", QJsonValue::String}, {"p", QJsonValue::String}}, [this](const QJsonObject &params) { startAccessPoint(params); });
+
+    enableSubscriptions(MethodSubscribe, MethodUnsubscribe);
+    registerNotification(NotificationWirelessStateChanged);
+    registerNotification(NotificationNetworksChanged, &NetworkManagerService::filterNetworks);
+    registerNotification(NotificationAddressChanged);
+    registerNotification(NotificationAccessPointFound, &NetworkManagerService::filterAccessPoint);
+    registerNotification(NotificationScanFinished);
+    registerNotification(NotificationConnectProgress);
+    registerNotification(NotificationAccessPointChanged, &NetworkManagerService::filterAccessPoint);
+
+    connect(m_scanManager, &WirelessScanManager::accessPointFound, this, &NetworkManagerService::onAccessPointFound);
+    connect(m_scanManager, &WirelessScanManager::accessPointChanged, this, &NetworkManagerService::onAccessPointChanged);
+    connect(m_scanManager, &WirelessScanManager::scanFinished, this, &NetworkManagerService::onScanFinished);
+    connect(m_addressCache, &InterfaceAddressCache::addressesChanged, this, &NetworkManagerService::onAddressesChanged);
+    if (wirelessDevice()) {
+        connect(wirelessDevice(), &WirelessNetworkDevice::stateChanged, this, &NetworkManagerService::onWirelessDeviceStateChanged);
+    }
 
+    m_connectTimer.setSingleShot(true);
+    connect(&m_connectTimer, &QTimer::timeout, this, &NetworkManagerService::onConnectTimeout);
 }
 
 NetworkManagerService::~NetworkManagerService()
@@ -50,17 +86,20 @@ QString NetworkManagerService::name() const
 
 QBluetoothUuid NetworkManagerService::serviceUuid() const
 {
-    return QBluetoothUuid(QUuid("d918edd0-bdb8-4b4b-b7e1-b15d50d361a2"));
+    static const QBluetoothUuid uuid(QUuid("d918edd0-bdb8-4b4b-b7e1-b15d50d361a2"));
+    return uuid;
 }
 
 QBluetoothUuid NetworkManagerService::receiverCharacteristicUuid() const
 {
-    return QBluetoothUuid(QUuid("d918edd1-bdb8-4b4b-b7e1-b15d50d361a2"));
+    static const QBluetoothUuid uuid(QUuid("d918edd1-bdb8-4b4b-b7e1-b15d50d361a2"));
+    return uuid;
 }
 
 QBluetoothUuid NetworkManagerService::senderCharacteristicUuid() const
 {
-    return QBluetoothUuid(QUuid("d918edd2-bdb8-4b4b-b7e1-b15d50d361a2"));
+    static const QBluetoothUuid uuid(QUuid("d918edd2-bdb8-4b4b-b7e1-b15d50d361a2"));
+    return uuid;
 }
 
 bool NetworkManagerService::useEncryption() const
@@ -68,7 +107,535 @@ bool NetworkManagerService::useEncryption() const
     return true;
 }
 
-void NetworkManagerService::receiveData(const QByteArray &data)
+WirelessNetworkDevice *NetworkManagerService::wirelessDevice() const
+{
+    if (!m_networkManager->wirelessAvailable())
+        return nullptr;
+
+    return m_networkManager->wirelessNetworkDevices().first();
+}
+
+NetworkManagerService::ResponseCode NetworkManagerService::checkWirelessErrors() const
+{
+    if (!m_networkManager->available()) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "the networkmanager is not available.";
+        return ResponseCodeNetworkManagerNotAvailable;
+    }
+
+    if (!wirelessDevice()) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "there is no wireless device available.";
+        return ResponseCodeWirelessNotAvailable;
+    }
+
+    if (!m_networkManager->networkingEnabled()) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "networking not enabled.";
+        return ResponseCodeNetworkingNotEnabled;
+    }
+
+    if (!m_networkManager->wirelessEnabled()) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "wireless not enabled.";
+        return ResponseCodeWirelessNotEnabled;
+    }
+
+    return ResponseCodeSuccess;
+}
+
+QHostAddress NetworkManagerService::currentAddress(WirelessNetworkDevice *device) const
+{
+    // Note: for now, we'll just use the first IPv4 address like the deprecated wireless service
+    return m_addressCache->ipv4Address(device->interface());
+}
+
+void NetworkManagerService::updateAccessPoints(WirelessNetworkDevice *device)
+{
+    // Compare the current access points with the reported ones. All changes get the same new generation.
+    qint64 generation = m_generation + 1;
+    bool changed = false;
+
+    QHash<QString, AccessPointEntry> previousAccessPoints = m_accessPoints;
+    foreach (WirelessAccessPoint *accessPoint, device->accessPoints()) {
+        AccessPointEntry entry = previousAccessPoints.take(accessPoint->macAddress());
+        int signalStrength = static_cast<int>(accessPoint->signalStrength());
+        bool known = entry.generation != 0;
+
+        // Note: the signal strength varies on each scan, report it only if it changed noticeably
+        if (known && entry.ssid == accessPoint->ssid() && entry.isProtected == accessPoint->isProtected()
+                && qAbs(entry.signalStrength - signalStrength) < m_signalStrengthThreshold) {
+            continue;
+        }
+
+        entry.ssid = accessPoint->ssid();
+        entry.macAddress = accessPoint->macAddress();
+        entry.signalStrength = signalStrength;
+        entry.isProtected = accessPoint->isProtected();
+        entry.generation = generation;
+        m_accessPoints.insert(entry.macAddress, entry);
+        m_removedAccessPoints.remove(entry.macAddress);
+        changed = true;
+    }
+
+    // Whatever is left has disappeared
+    foreach (const QString &macAddress, previousAccessPoints.keys()) {
+        m_accessPoints.remove(macAddress);
+        m_removedAccessPoints.insert(macAddress, generation);
+        changed = true;
+    }
+
+    if (!changed)
+        return;
+
+    m_generation = generation;
+
+    // Forget the oldest removals, clients with an older token will get the full list
+    while (m_removedAccessPoints.count() > m_removedAccessPointLimit) {
+        QHash<QString, qint64>::iterator oldest = m_removedAccessPoints.begin();
+        for (QHash<QString, qint64>::iterator it = m_removedAccessPoints.begin(); it != m_removedAccessPoints.end(); ++it) {
+            if (it.value() < oldest.value()) {
+                oldest = it;
+            }
+        }
+
+        m_oldestGeneration = qMax(m_oldestGeneration, oldest.value());
+        m_removedAccessPoints.erase(oldest);
+    }
+}
+
+void NetworkManagerService::writeAccessPoint(JsonWriter &writer, const AccessPointEntry &accessPoint) const
+{
+    writer.beginObject();
+    writer.writeKey("e");
+    writer.writeValue(accessPoint.ssid);
+    writer.writeKey("m");
+    writer.writeValue(accessPoint.macAddress);
+    writer.writeKey("s");
+    writer.writeValue(accessPoint.signalStrength);
+    writer.writeKey("p");
+    writer.writeValue(static_cast<int>(accessPoint.isProtected));
+    writer.endObject();
+}
+
+QJsonObject NetworkManagerService::accessPointObject(const AccessPointEntry &accessPoint) const
+{
+    QJsonObject accessPointObject;
+    accessPointObject.insert("e", accessPoint.ssid);
+    accessPointObject.insert("m", accessPoint.macAddress);
+    accessPointObject.insert("s", accessPoint.signalStrength);
+    accessPointObject.insert("p", static_cast<int>(accessPoint.isProtected));
+    return accessPointObject;
+}
+
+bool NetworkManagerService::filterNetworks(const QJsonObject &filter, QJsonObject &params)
+{
+    // Supported filter: minimum signal strength "s"
+    if (!filter.value("s").isDouble())
+        return true;
+
+    int minimumSignalStrength = filter.value("s").toInt();
+    QJsonArray accessPoints;
+    foreach (const QJsonValue &accessPoint, params.value("a").toArray()) {
+        if (accessPoint.toObject().value("s").toInt() >= minimumSignalStrength) {
+            accessPoints.append(accessPoint);
+        }
+    }
+    params.insert("a", accessPoints);
+
+    return !accessPoints.isEmpty() || !params.value("r").toArray().isEmpty();
+}
+
+bool NetworkManagerService::filterAccessPoint(const QJsonObject &filter, QJsonObject &params)
+{
+    // Supported filter: minimum signal strength "s"
+    if (!filter.value("s").isDouble())
+        return true;
+
+    return params.value("s").toInt() >= filter.value("s").toInt();
+}
+
+void NetworkManagerService::getNetworks(const QJsonObject &params)
+{
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodGetNetworks, responseCode);
+        return;
+    }
+
+    updateAccessPoints(wirelessDevice());
+
+    // A known generation token gets only the changes since then, anything else the full list
+    qint64 clientGeneration = 0;
+    if (params.value("g").isDouble())
+        clientGeneration = static_cast<qint64>(params.value("g").toDouble());
+
+    // Note: the generation tracks the whole list, a filtered request always gets the full filtered list
+    AccessPointFilter filter = AccessPointFilter::fromParams(params);
+    bool incremental = filter.isEmpty() && clientGeneration >= m_oldestGeneration && clientGeneration <= m_generation;
+
+    QList<AccessPointEntry> accessPoints;
+    if (filter.isEmpty()) {
+        accessPoints = m_accessPoints.values();
+    } else {
+        // Note: the reported signal strength only follows noticeable changes, filter, sort and report the current one
+        foreach (WirelessAccessPoint *accessPoint, filter.apply(wirelessDevice()->accessPoints())) {
+            AccessPointEntry entry = m_accessPoints.value(accessPoint->macAddress());
+            entry.ssid = accessPoint->ssid();
+            entry.macAddress = accessPoint->macAddress();
+            entry.signalStrength = static_cast<int>(accessPoint->signalStrength());
+            entry.isProtected = accessPoint->isProtected();
+            accessPoints.append(entry);
+        }
+    }
+
+    // Note: write the list directly, an access point takes roughly 70 bytes
+    JsonWriter responseParams(48 + 80 * accessPoints.count());
+    responseParams.beginObject();
+    responseParams.writeKey("g");
+    responseParams.writeValue(m_generation);
+    responseParams.writeKey("i");
+    responseParams.writeValue(incremental);
+    responseParams.writeKey("a");
+    responseParams.beginArray();
+    foreach (const AccessPointEntry &accessPoint, accessPoints) {
+        if (!incremental || accessPoint.generation > clientGeneration) {
+            writeAccessPoint(responseParams, accessPoint);
+        }
+    }
+    responseParams.endArray();
+
+    if (incremental) {
+        responseParams.writeKey("r");
+        responseParams.beginArray();
+        for (QHash<QString, qint64>::const_iterator it = m_removedAccessPoints.constBegin(); it != m_removedAccessPoints.constEnd(); ++it) {
+            if (it.value() > clientGeneration) {
+                responseParams.writeValue(it.key());
+            }
+        }
+        responseParams.endArray();
+    }
+    responseParams.endObject();
+
+    qCDebug(dcNymeaBluetoothServer()) << name() << "sending" << (incremental ? "changed" : "all") << "networks of generation" << m_generation;
+    sendResponse(MethodGetNetworks, ResponseCodeSuccess, responseParams);
+}
+
+void NetworkManagerService::connectNetwork(const QJsonObject &params)
+{
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodConnect, responseCode);
+        return;
+    }
+
+    NetworkManager::NetworkManagerError networkError = m_networkManager->connectWifi(wirelessDevice()->interface(), params.value("e").toString(), params.value("p").toString());
+    switch (networkError) {
+    case NetworkManager::NetworkManagerErrorNoError:
+        break;
+    case NetworkManager::NetworkManagerErrorWirelessNetworkingDisabled:
+        responseCode = ResponseCodeWirelessNotEnabled;
+        break;
+    default:
+        qCWarning(dcNymeaBluetoothServer()) << name() << "failed to connect to the wireless network:" << networkError;
+        responseCode = ResponseCodeUnknownError;
+        break;
+    }
+
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodConnect, responseCode);
+        return;
+    }
+
+    // The connection has only been requested, the result will be notified using the returned operation id
+    if (m_connectTimer.isActive())
+        finishConnectOperation(ConnectProgressFailed, ConnectFailureSuperseded);
+
+    m_connectOperation++;
+    m_connectSession = session();
+    m_connectProgress = ConnectProgressNone;
+    m_connectSecretsRequested = false;
+    m_connectTimer.start(m_connectTimeout);
+    qCDebug(dcNymeaBluetoothServer()) << name() << "connect operation" << m_connectOperation << "started for" << params.value("e").toString();
+
+    JsonWriter responseParams;
+    responseParams.beginObject();
+    responseParams.writeKey("o");
+    responseParams.writeValue(m_connectOperation);
+    responseParams.endObject();
+    sendResponse(MethodConnect, ResponseCodeSuccess, responseParams);
+}
+
+void NetworkManagerService::disconnectNetwork(const QJsonObject &params)
 {
-    qCDebug(dcNymeaBluetoothServer()) << name() << "message received" << qUtf8Printable(data);
+    Q_UNUSED(params)
+
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodDisconnect, responseCode);
+        return;
+    }
+
+    wirelessDevice()->disconnectDevice();
+    sendResponse(MethodDisconnect, ResponseCodeSuccess);
+}
+
+void NetworkManagerService::scan(const QJsonObject &params)
+{
+    Q_UNUSED(params)
+
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodScan, responseCode);
+        return;
+    }
+
+    // Tell the client whether the current list is already fresh or it should wait for the scan
+    WirelessScanManager::ScanRequestResult scanResult = m_scanManager->requestScan();
+    if (scanResult == WirelessScanManager::ScanRequestResultUnavailable) {
+        sendResponse(MethodScan, ResponseCodeWirelessNotAvailable);
+        return;
+    }
+
+    JsonWriter responseParams;
+    responseParams.beginObject();
+    responseParams.writeKey("f");
+    responseParams.writeValue(scanResult == WirelessScanManager::ScanRequestResultCached);
+    responseParams.endObject();
+    sendResponse(MethodScan, ResponseCodeSuccess, responseParams);
+}
+
+void NetworkManagerService::getCurrentConnection(const QJsonObject &params)
+{
+    Q_UNUSED(params)
+
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodGetCurrentConnection, responseCode);
+        return;
+    }
+
+    WirelessNetworkDevice *device = wirelessDevice();
+    WirelessAccessPoint *activeAccessPoint = device->activeAccessPoint();
+    QHostAddress address = currentAddress(device);
+
+    JsonWriter responseParams;
+    responseParams.beginObject();
+    if (!activeAccessPoint || address.isNull()) {
+        qCDebug(dcNymeaBluetoothServer()) << name() << "there is currently no active access point";
+        responseParams.writeKey("e");
+        responseParams.writeValue("");
+        responseParams.writeKey("m");
+        responseParams.writeValue("");
+        responseParams.writeKey("s");
+        responseParams.writeValue(0);
+        responseParams.writeKey("p");
+        responseParams.writeValue(0);
+        responseParams.writeKey("i");
+        responseParams.writeValue("");
+    } else {
+        qCDebug(dcNymeaBluetoothServer()) << name() << "current connection:" << activeAccessPoint << address.toString();
+        responseParams.writeKey("e");
+        responseParams.writeValue(activeAccessPoint->ssid());
+        responseParams.writeKey("m");
+        responseParams.writeValue(activeAccessPoint->macAddress());
+        responseParams.writeKey("s");
+        responseParams.writeValue(static_cast<int>(activeAccessPoint->signalStrength()));
+        responseParams.writeKey("p");
+        responseParams.writeValue(static_cast<int>(activeAccessPoint->isProtected()));
+        responseParams.writeKey("i");
+        responseParams.writeValue(address.toString());
+    }
+    responseParams.endObject();
+
+    sendResponse(MethodGetCurrentConnection, ResponseCodeSuccess, responseParams);
+}
+
+void NetworkManagerService::startAccessPoint(const QJsonObject &params)
+{
+    ResponseCode responseCode = checkWirelessErrors();
+    if (responseCode != ResponseCodeSuccess) {
+        sendResponse(MethodStartAccessPoint, responseCode);
+        return;
+    }
+
+    QString essid = params.value("e").toString();
+    if (essid.isEmpty() || essid.length() > 32) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "invalid ESSID (e) parameter.";
+        sendResponse(MethodStartAccessPoint, ResponseCodeInvalidParams);
+        return;
+    }
+
+    QString passkey = params.value("p").toString();
+    if (passkey.length() < 8 || passkey.length() > 64) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "invalid passkey (p) parameter.";
+        sendResponse(MethodStartAccessPoint, ResponseCodeInvalidParams);
+        return;
+    }
+
+    NetworkManager::NetworkManagerError networkError = m_networkManager->startAccessPoint(wirelessDevice()->interface(), essid, passkey);
+    if (networkError != NetworkManager::NetworkManagerErrorNoError) {
+        qCWarning(dcNymeaBluetoothServer()) << name() << "failed to start the access point:" << networkError;
+        sendResponse(MethodStartAccessPoint, ResponseCodeUnknownError);
+        return;
+    }
+
+    sendResponse(MethodStartAccessPoint, ResponseCodeSuccess);
+}
+
+void NetworkManagerService::onAccessPointFound(WirelessAccessPoint *accessPoint)
+{
+    if (!subscribed(NotificationAccessPointFound))
+        return;
+
+    AccessPointEntry entry;
+    entry.ssid = accessPoint->ssid();
+    entry.macAddress = accessPoint->macAddress();
+    entry.signalStrength = static_cast<int>(accessPoint->signalStrength());
+    entry.isProtected = accessPoint->isProtected();
+
+    // Note: each access point is a notification of its own, so the client can show it right away
+    sendNotification(NotificationAccessPointFound, accessPointObject(entry), false);
+}
+
+void NetworkManagerService::onAccessPointChanged(WirelessAccessPoint *accessPoint)
+{
+    if (!subscribed(NotificationAccessPointChanged))
+        return;
+
+    AccessPointEntry entry;
+    entry.ssid = accessPoint->ssid();
+    entry.macAddress = accessPoint->macAddress();
+    entry.signalStrength = static_cast<int>(accessPoint->signalStrength());
+    entry.isProtected = accessPoint->isProtected();
+
+    sendNotification(NotificationAccessPointChanged, accessPointObject(entry), false);
+}
+
+void NetworkManagerService::onScanFinished()
+{
+    // End of the streamed access points
+    if (subscribed(NotificationScanFinished)) {
+        QJsonObject params;
+        params.insert("c", m_scanManager->foundAccessPointCount());
+        sendNotification(NotificationScanFinished, params, false);
+    }
+
+    if (!subscribed(NotificationNetworksChanged) || !wirelessDevice())
+        return;
+
+    // Push the changes of this scan, earlier changes have been sent already or returned by GetNetworks
+    qint64 previousGeneration = m_generation;
+    updateAccessPoints(wirelessDevice());
+    if (m_generation == previousGeneration)
+        return;
+
+    QJsonArray accessPoints;
+    foreach (const AccessPointEntry &accessPoint, m_accessPoints) {
+        if (accessPoint.generation > previousGeneration) {
+            accessPoints.append(accessPointObject(accessPoint));
+        }
+    }
+
+    QJsonArray removedAccessPoints;
+    for (QHash<QString, qint64>::const_iterator it = m_removedAccessPoints.constBegin(); it != m_removedAccessPoints.constEnd(); ++it) {
+        if (it.value() > previousGeneration) {
+            removedAccessPoints.append(it.key());
+        }
+    }
+
+    QJsonObject params;
+    params.insert("g", static_cast<double>(m_generation));
+    params.insert("a", accessPoints);
+    params.insert("r", removedAccessPoints);
+    sendNotification(NotificationNetworksChanged, params);
+}
+
+void NetworkManagerService::setConnectProgress(ConnectProgress connectProgress, ConnectFailure connectFailure)
+{
+    if (m_connectProgress == connectProgress)
+        return;
+
+    m_connectProgress = connectProgress;
+    qCDebug(dcNymeaBluetoothServer()) << name() << "connect operation" << m_connectOperation << connectProgress;
+
+    QJsonObject params;
+    params.insert("o", m_connectOperation);
+    params.insert("s", static_cast<int>(connectProgress));
+    if (connectProgress == ConnectProgressFailed)
+        params.insert("r", static_cast<int>(connectFailure));
+
+    // The client which started the operation gets the progress also without a subscription
+    if (!m_connectSession.isNull() && m_connectSession == session()) {
+        sendRequestedNotification(NotificationConnectProgress, params);
+    } else {
+        sendNotification(NotificationConnectProgress, params);
+    }
+}
+
+void NetworkManagerService::finishConnectOperation(ConnectProgress connectProgress, ConnectFailure connectFailure)
+{
+    m_connectTimer.stop();
+    setConnectProgress(connectProgress, connectFailure);
+    m_connectProgress = ConnectProgressNone;
+}
+
+void NetworkManagerService::onConnectTimeout()
+{
+    qCWarning(dcNymeaBluetoothServer()) << name() << "connect operation" << m_connectOperation << "timed out";
+    finishConnectOperation(ConnectProgressFailed, ConnectFailureTimeout);
+}
+
+void NetworkManagerService::onWirelessDeviceStateChanged(const NetworkDevice::NetworkDeviceState &state)
+{
+    if (m_connectTimer.isActive()) {
+        switch (state) {
+        case NetworkDevice::NetworkDeviceStatePrepare:
+        case NetworkDevice::NetworkDeviceStateConfig:
+            setConnectProgress(ConnectProgressAssociating);
+            break;
+        case NetworkDevice::NetworkDeviceStateNeedAuth:
+            m_connectSecretsRequested = true;
+            setConnectProgress(ConnectProgressAuthenticating);
+            break;
+        case NetworkDevice::NetworkDeviceStateIpConfig:
+        case NetworkDevice::NetworkDeviceStateIpCheck:
+        case NetworkDevice::NetworkDeviceStateSecondaries:
+            setConnectProgress(ConnectProgressIpConfig);
+            break;
+        case NetworkDevice::NetworkDeviceStateActivated:
+            finishConnectOperation(ConnectProgressConnected);
+            break;
+        case NetworkDevice::NetworkDeviceStateFailed:
+            finishConnectOperation(ConnectProgressFailed, m_connectSecretsRequested ? ConnectFailureAuthentication : ConnectFailureUnknown);
+            break;
+        case NetworkDevice::NetworkDeviceStateDisconnected:
+            // Note: the previous connection will be deactivated before the new one gets prepared
+            if (m_connectProgress != ConnectProgressNone)
+                finishConnectOperation(ConnectProgressFailed, m_connectSecretsRequested ? ConnectFailureAuthentication : ConnectFailureUnknown);
+
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (subscribed(NotificationWirelessStateChanged)) {
+        QJsonObject params;
+        params.insert("s", static_cast<int>(static_cast<quint8>(WirelessService::getWirelessNetworkDeviceState(state).at(0))));
+        sendNotification(NotificationWirelessStateChanged, params);
+    }
+
+    // The address changes along with the device state, only the actual changes will be sent
+    if (subscribed(NotificationAddressChanged)) {
+        QJsonObject params;
+        params.insert("i", currentAddress(wirelessDevice()).toString());
+        sendNotification(NotificationAddressChanged, params);
+    }
+}
+
+void NetworkManagerService::onAddressesChanged()
+{
+    if (!subscribed(NotificationAddressChanged) || !wirelessDevice())
+        return;
+
+    QJsonObject params;
+    params.insert("i", currentAddress(wirelessDevice()).toString());
+    sendNotification(NotificationAddressChanged, params);
 }
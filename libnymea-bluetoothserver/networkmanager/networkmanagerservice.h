@@ -31,16 +31,78 @@
 #ifndef NETWORKMANAGERSERVICE_H
 #define NETWORKMANAGERSERVICE_H
 
+#include <QHash>
+#include <QTimer>
 #include <QObject>
+#include <QHostAddress>
 
 #include "networkmanager.h"
+#include "wirelessaccesspoint.h"
+#include "wirelessnetworkdevice.h"
 #include "bluetoothservice.h"
+#include "wirelessscanmanager.h"
+#include "interfaceaddresscache.h"
 
 class NetworkManagerService : public BluetoothService
 {
     Q_OBJECT
 public:
-    explicit NetworkManagerService(NetworkManager *networkManager, QObject *parent = nullptr);
+    enum Method {
+        MethodUnknown = -1,
+        MethodGetNetworks = 0,
+        MethodConnect = 1,
+        MethodDisconnect = 2,
+        MethodScan = 3,
+        MethodGetCurrentConnection = 4,
+        MethodStartAccessPoint = 5,
+        MethodSubscribe = 6,
+        MethodUnsubscribe = 7
+    };
+    Q_ENUM(Method)
+
+    enum Notification {
+        NotificationWirelessStateChanged = 0,
+        NotificationNetworksChanged = 1,
+        NotificationAddressChanged = 2,
+        NotificationAccessPointFound = 3,
+        NotificationScanFinished = 4,
+        NotificationConnectProgress = 5,
+        NotificationAccessPointChanged = 6
+    };
+    Q_ENUM(Notification)
+
+    enum ConnectProgress {
+        ConnectProgressNone = 0,
+        ConnectProgressAssociating = 1,
+        ConnectProgressAuthenticating = 2,
+        ConnectProgressIpConfig = 3,
+        ConnectProgressConnected = 4,
+        ConnectProgressFailed = 5
+    };
+    Q_ENUM(ConnectProgress)
+
+    enum ConnectFailure {
+        ConnectFailureUnknown = 0,
+        ConnectFailureAuthentication = 1,
+        ConnectFailureTimeout = 2,
+        ConnectFailureSuperseded = 3
+    };
+    Q_ENUM(ConnectFailure)
+
+    enum ResponseCode {
+        ResponseCodeSuccess = BluetoothService::ResponseCodeSuccess,
+        ResponseCodeInvalidProtocol = BluetoothService::ResponseCodeInvalidProtocol,
+        ResponseCodeInvalidMethod = BluetoothService::ResponseCodeInvalidMethod,
+        ResponseCodeInvalidParams = BluetoothService::ResponseCodeInvalidParams,
+        ResponseCodeNetworkManagerNotAvailable = BluetoothService::ResponseCodeCustom,
+        ResponseCodeWirelessNotAvailable = 5,
+        ResponseCodeWirelessNotEnabled = 6,
+        ResponseCodeNetworkingNotEnabled = 7,
+        ResponseCodeUnknownError = 8
+    };
+    Q_ENUM(ResponseCode)
+
+    explicit NetworkManagerService(NetworkManager *networkManager, WirelessScanManager *scanManager, InterfaceAddressCache *addressCache, QObject *parent = nullptr);
     ~NetworkManagerService() override;
 
     QString name() const override;
@@ -49,11 +111,67 @@ public:
     QBluetoothUuid senderCharacteristicUuid() const override;
     bool useEncryption() const override;
 
-public slots:
-    void receiveData(const QByteArray &data) override;
-
 private:
+    // Access point as reported to the clients, keyed by the MAC address
+    class AccessPointEntry
+    {
+    public:
+        QString ssid;
+        QString macAddress;
+        int signalStrength = 0;
+        bool isProtected = false;
+        qint64 generation = 0; // Generation of the last reported change
+    };
+
     NetworkManager *m_networkManager = nullptr;
+    WirelessScanManager *m_scanManager = nullptr;
+    InterfaceAddressCache *m_addressCache = nullptr;
+
+    // Access point list generations for incremental GetNetworks responses. The first generation is
+    // derived from the start time, so tokens of a previous run will never be mistaken as valid.
+    qint64 m_generation = 0;
+    qint64 m_oldestGeneration = 0;
+    QHash<QString, AccessPointEntry> m_accessPoints;
+    QHash<QString, qint64> m_removedAccessPoints;
+    int m_removedAccessPointLimit = 64;
+    int m_signalStrengthThreshold = 5;
+
+    // The running connect operation and the session which started it, the progress will be notified along with the operation id
+    int m_connectOperation = 0;
+    QPointer<BluetoothSession> m_connectSession;
+    ConnectProgress m_connectProgress = ConnectProgressNone;
+    bool m_connectSecretsRequested = false;
+    QTimer m_connectTimer;
+    int m_connectTimeout = 60000;
+
+    void setConnectProgress(ConnectProgress connectProgress, ConnectFailure connectFailure = ConnectFailureUnknown);
+    void finishConnectOperation(ConnectProgress connectProgress, ConnectFailure connectFailure = ConnectFailureUnknown);
+
+    WirelessNetworkDevice *wirelessDevice() const;
+    ResponseCode checkWirelessErrors() const;
+    QHostAddress currentAddress(WirelessNetworkDevice *device) const;
+    void updateAccessPoints(WirelessNetworkDevice *device);
+    void writeAccessPoint(JsonWriter &writer, const AccessPointEntry &accessPoint) const;
+    QJsonObject accessPointObject(const AccessPointEntry &accessPoint) const;
+
+    static bool filterNetworks(const QJsonObject &filter, QJsonObject &params);
+    static bool filterAccessPoint(const QJsonObject &filter, QJsonObject &params);
+
+    // Methods
+    void getNetworks(const QJsonObject &params);
+    void connectNetwork(const QJsonObject &params);
+    void disconnectNetwork(const QJsonObject &params);
+    void scan(const QJsonObject &params);
+    void getCurrentConnection(const QJsonObject &params);
+    void startAccessPoint(const QJsonObject &params);
+
+private slots:
+    void onAccessPointFound(WirelessAccessPoint *accessPoint);
+    void onAccessPointChanged(WirelessAccessPoint *accessPoint);
+    void onScanFinished();
+    void onConnectTimeout();
+    void onAddressesChanged();
+    void onWirelessDeviceStateChanged(const NetworkDevice::NetworkDeviceState &state);
 
 };
 
@@ -41,6 +41,8 @@ NetworkService::NetworkService(QLowEnergyService *service, NetworkManager *netwo
 {
     qCDebug(dcNymeaBluetoothServer()) << "Create NetworkService.";
 
+    m_notifier = new CharacteristicNotifier(m_service, this);
+
     // Service
     connect(m_service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
     connect(m_service, SIGNAL(characteristicRead(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
@@ -59,6 +61,20 @@ QLowEnergyService *NetworkService::service()
     return m_service;
 }
 
+void NetworkService::setSession(BluetoothSession *session)
+{
+    m_session = session;
+    m_notifier->setSession(session);
+    if (!m_session.isNull()) {
+        m_session->loadClientConfigurations(m_service);
+    }
+}
+
+CharacteristicNotifier *NetworkService::notifier() const
+{
+    return m_notifier;
+}
+
 QLowEnergyServiceData NetworkService::serviceData(NetworkManager *networkManager)
 {
     QLowEnergyServiceData serviceData;
@@ -201,6 +217,8 @@ NetworkService::NetworkServiceCommand NetworkService::verifyCommand(const QByteA
 void NetworkService::characteristicChanged(const QLowEnergyCharacteristic &characteristic, const QByteArray &value)
 {
     if (characteristic.uuid() == networkCommanderCharacteristicUuid) {
+        if (!m_session.isNull())
+            m_session->notifyDataReceived(value.count());
 
         NetworkServiceCommand command = verifyCommand(value);
         if (command == NetworkServiceCommandInvalid) {
@@ -242,6 +260,9 @@ void NetworkService::descriptorRead(const QLowEnergyDescriptor &descriptor, cons
 void NetworkService::descriptorWritten(const QLowEnergyDescriptor &descriptor, const QByteArray &value)
 {
     qCDebug(dcNymeaBluetoothServer()) << "NetworkService: Descriptor written" << descriptor.uuid().toString() << value;
+    if (!m_session.isNull()) {
+        m_session->updateClientConfiguration(m_service, descriptor, value);
+    }
 }
 
 void NetworkService::serviceError(const QLowEnergyService::ServiceError &error)
@@ -307,14 +328,8 @@ bool NetworkService::onNetworkManagerStateChanged()
         return false;
     }
 
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(networkStatusCharacteristicUuid);
-    if (!characteristic.isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "NetworkService: Could not update network manager status. Characteristic not valid";
-        return false;
-    }
-
     qCDebug(dcNymeaBluetoothServer()) << "NetworkService: Notify state changed" << NetworkService::getNetworkManagerStateByteArray(m_networkManager->state());
-    m_service->writeCharacteristic(characteristic, NetworkService::getNetworkManagerStateByteArray(m_networkManager->state()));
+    m_notifier->notify(networkStatusCharacteristicUuid, NetworkService::getNetworkManagerStateByteArray(m_networkManager->state()));
     return true;
 }
 
@@ -325,14 +340,8 @@ bool NetworkService::onNetworkingEnabledChanged()
         return false;
     }
 
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(networkingEnabledCharacteristicUuid);
-    if (!characteristic.isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "NetworkService: Could not set networking enabled. Characteristic not valid";
-        return false;
-    }
-
     qCDebug(dcNymeaBluetoothServer()) << "NetworkService: Notify networking enabled changed:" << (m_networkManager->networkingEnabled() ? "enabled" : "disabled");
-    m_service->writeCharacteristic(characteristic, m_networkManager->networkingEnabled() ? QByteArray::fromHex("01") : QByteArray::fromHex("00"));
+    m_notifier->notify(networkingEnabledCharacteristicUuid, m_networkManager->networkingEnabled() ? QByteArray::fromHex("01") : QByteArray::fromHex("00"));
     return true;
 }
 
@@ -343,13 +352,7 @@ bool NetworkService::onWirelessEnabledChanged()
         return false;
     }
 
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(wirelessEnabledCharacteristicUuid);
-    if (!characteristic.isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "NetworkService: Could not set wireless enabled. Characteristic not valid";
-        return false;
-    }
-
     qCDebug(dcNymeaBluetoothServer()) << "NetworkService: Notify wireless networking enabled changed:" << (m_networkManager->wirelessEnabled() ? "enabled" : "disabled");
-    m_service->writeCharacteristic(characteristic, m_networkManager->wirelessEnabled() ? QByteArray::fromHex("01") : QByteArray::fromHex("00"));
+    m_notifier->notify(wirelessEnabledCharacteristicUuid, m_networkManager->wirelessEnabled() ? QByteArray::fromHex("01") : QByteArray::fromHex("00"));
     return true;
 }
@@ -32,11 +32,14 @@
 #define NETWORKSERVICE_H
 
 #include <QObject>
+#include <QPointer>
 #include <QLowEnergyService>
 #include <QLowEnergyServiceData>
 
 #include <networkmanager.h>
 
+#include "characteristicnotifier.h"
+
 static QBluetoothUuid networkServiceUuid =                  QBluetoothUuid(QUuid("ef6d6610-b8af-49e0-9eca-ab343513641c"));
 static QBluetoothUuid networkStatusCharacteristicUuid =     QBluetoothUuid(QUuid("ef6d6611-b8af-49e0-9eca-ab343513641c"));
 static QBluetoothUuid networkCommanderCharacteristicUuid =  QBluetoothUuid(QUuid("ef6d6612-b8af-49e0-9eca-ab343513641c"));
@@ -71,12 +74,20 @@ public:
 
     QLowEnergyService *service();
 
+    // The session of the connected client, responses will only be written if it enabled the notifications
+    void setSession(BluetoothSession *session);
+
+    // Conflates the notifications of the status characteristics
+    CharacteristicNotifier *notifier() const;
+
     static QLowEnergyServiceData serviceData(NetworkManager *networkManager);
     static QByteArray getNetworkManagerStateByteArray(const NetworkManager::NetworkManagerState &state);
 
 private:
     QLowEnergyService *m_service = nullptr;
     NetworkManager *m_networkManager = nullptr;
+    CharacteristicNotifier *m_notifier = nullptr;
+    QPointer<BluetoothSession> m_session;
 
     void sendResponse(const NetworkServiceResponse &response);
 
@@ -0,0 +1,213 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "wirelessscanmanager.h"
+#include "loggingcategories.h"
+
+#include <QDBusConnection>
+
+static const QString networkManagerServiceName = "org.freedesktop.NetworkManager";
+static const QString wirelessDeviceInterfaceName = "org.freedesktop.NetworkManager.Device.Wireless";
+static const QString propertiesInterfaceName = "org.freedesktop.DBus.Properties";
+
+// Smaller changes of the signal strength in % will not be reported
+static const int signalStrengthThreshold = 5;
+
+WirelessScanManager::WirelessScanManager(NetworkManager *networkManager, QObject *parent) :
+    QObject(parent),
+    m_networkManager(networkManager)
+{
+    m_scanTimer.setSingleShot(true);
+    connect(&m_scanTimer, &QTimer::timeout, this, &WirelessScanManager::onScanTimeout);
+
+    connect(&m_samplingTimer, &QTimer::timeout, this, &WirelessScanManager::sampleAccessPoints);
+}
+
+int WirelessScanManager::cacheTimeout() const
+{
+    return m_cacheTimeout;
+}
+
+void WirelessScanManager::setCacheTimeout(int cacheTimeout)
+{
+    m_cacheTimeout = qMax(0, cacheTimeout);
+}
+
+int WirelessScanManager::scanTimeout() const
+{
+    return m_scanTimeout;
+}
+
+void WirelessScanManager::setScanTimeout(int scanTimeout)
+{
+    m_scanTimeout = qMax(0, scanTimeout);
+}
+
+int WirelessScanManager::samplingInterval() const
+{
+    return m_samplingInterval;
+}
+
+void WirelessScanManager::setSamplingInterval(int samplingInterval)
+{
+    m_samplingInterval = qMax(10, samplingInterval);
+}
+
+bool WirelessScanManager::scanning() const
+{
+    return m_scanTimer.isActive();
+}
+
+bool WirelessScanManager::resultsFresh() const
+{
+    return m_lastScanTimer.isValid() && m_lastScanTimer.elapsed() < m_cacheTimeout;
+}
+
+int WirelessScanManager::scanCount() const
+{
+    return m_scanCount;
+}
+
+int WirelessScanManager::mergedRequestCount() const
+{
+    return m_mergedRequestCount;
+}
+
+int WirelessScanManager::cachedRequestCount() const
+{
+    return m_cachedRequestCount;
+}
+
+int WirelessScanManager::foundAccessPointCount() const
+{
+    return m_foundAccessPointCount;
+}
+
+WirelessScanManager::ScanRequestResult WirelessScanManager::requestScan()
+{
+    if (scanning()) {
+        m_mergedRequestCount++;
+        qCDebug(dcNymeaBluetoothServer()) << "Wireless scan already running. Merging scan request.";
+        return ScanRequestResultMerged;
+    }
+
+    if (resultsFresh()) {
+        m_cachedRequestCount++;
+        qCDebug(dcNymeaBluetoothServer()) << "Wireless scan results are" << m_lastScanTimer.elapsed() << "ms old. Using cached results.";
+        return ScanRequestResultCached;
+    }
+
+    if (!m_networkManager->wirelessAvailable()) {
+        qCWarning(dcNymeaBluetoothServer()) << "Could not scan wireless networks. There is no wireless device available.";
+        return ScanRequestResultUnavailable;
+    }
+
+    // Note: NetworkManager updates the access point list while scanning and sets LastScan once the scan is complete.
+    // Newer versions notify property changes on the properties interface, older ones on the device interface itself.
+    WirelessNetworkDevice *wirelessDevice = m_networkManager->wirelessNetworkDevices().first();
+    m_scanDevicePath = wirelessDevice->objectPath().path();
+    QDBusConnection::systemBus().connect(networkManagerServiceName, m_scanDevicePath, propertiesInterfaceName, "PropertiesChanged", this, SLOT(onDevicePropertiesChanged(QString, QVariantMap, QStringList)));
+    QDBusConnection::systemBus().connect(networkManagerServiceName, m_scanDevicePath, wirelessDeviceInterfaceName, "PropertiesChanged", this, SLOT(onWirelessPropertiesChanged(QVariantMap)));
+
+    m_scanCount++;
+    qCDebug(dcNymeaBluetoothServer()) << "Start scanning wireless networks";
+    wirelessDevice->scanWirelessNetworks();
+    m_scanTimer.start(m_scanTimeout);
+
+    // The networkmanager library has no signal for single access points, so the list will be compared with
+    // the one from the scan start while scanning. Access points still cached from earlier scans are not new.
+    m_signalStrengths.clear();
+    foreach (WirelessAccessPoint *accessPoint, wirelessDevice->accessPoints())
+        m_signalStrengths.insert(accessPoint->macAddress(), static_cast<int>(accessPoint->signalStrength()));
+
+    m_foundAccessPointCount = 0;
+    m_samplingTimer.start(m_samplingInterval);
+    return ScanRequestResultStarted;
+}
+
+void WirelessScanManager::finishScan()
+{
+    m_scanTimer.stop();
+    QDBusConnection::systemBus().disconnect(networkManagerServiceName, m_scanDevicePath, propertiesInterfaceName, "PropertiesChanged", this, SLOT(onDevicePropertiesChanged(QString, QVariantMap, QStringList)));
+    QDBusConnection::systemBus().disconnect(networkManagerServiceName, m_scanDevicePath, wirelessDeviceInterfaceName, "PropertiesChanged", this, SLOT(onWirelessPropertiesChanged(QVariantMap)));
+    m_scanDevicePath.clear();
+
+    sampleAccessPoints();
+    m_samplingTimer.stop();
+
+    qCDebug(dcNymeaBluetoothServer()) << "Wireless scan finished. Found" << m_foundAccessPointCount << "new access points";
+    m_lastScanTimer.start();
+    emit scanFinished();
+}
+
+void WirelessScanManager::onScanTimeout()
+{
+    qCWarning(dcNymeaBluetoothServer()) << "NetworkManager did not report the end of the wireless scan within" << m_scanTimeout << "ms. Using the current results.";
+    finishScan();
+}
+
+void WirelessScanManager::onDevicePropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties)
+{
+    Q_UNUSED(invalidatedProperties)
+
+    if (interface == wirelessDeviceInterfaceName)
+        onWirelessPropertiesChanged(changedProperties);
+}
+
+void WirelessScanManager::onWirelessPropertiesChanged(const QVariantMap &changedProperties)
+{
+    if (!scanning() || !changedProperties.contains("LastScan"))
+        return;
+
+    qCDebug(dcNymeaBluetoothServer()) << "NetworkManager finished the wireless scan after" << m_scanTimeout - m_scanTimer.remainingTime() << "ms";
+    finishScan();
+}
+
+void WirelessScanManager::sampleAccessPoints()
+{
+    if (!m_networkManager->wirelessAvailable())
+        return;
+
+    foreach (WirelessAccessPoint *accessPoint, m_networkManager->wirelessNetworkDevices().first()->accessPoints()) {
+        int signalStrength = static_cast<int>(accessPoint->signalStrength());
+        QHash<QString, int>::iterator reportedSignalStrength = m_signalStrengths.find(accessPoint->macAddress());
+        if (reportedSignalStrength == m_signalStrengths.end()) {
+            m_signalStrengths.insert(accessPoint->macAddress(), signalStrength);
+            m_foundAccessPointCount++;
+            emit accessPointFound(accessPoint);
+            continue;
+        }
+
+        if (qAbs(signalStrength - reportedSignalStrength.value()) >= signalStrengthThreshold) {
+            reportedSignalStrength.value() = signalStrength;
+            emit accessPointChanged(accessPoint);
+        }
+    }
+}
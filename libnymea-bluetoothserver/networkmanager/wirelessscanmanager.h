@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef WIRELESSSCANMANAGER_H
+#define WIRELESSSCANMANAGER_H
+
+#include <QHash>
+#include <QTimer>
+#include <QObject>
+#include <QElapsedTimer>
+
+#include <networkmanager.h>
+#include <wirelessnetworkdevice.h>
+
+// Shared by the wireless services, so requests of several clients or services will not start
+// overlapping scans on the radio. Requests during a running scan will be merged into it and
+// results younger than the cache timeout will be served without scanning again. While scanning,
+// access points which were not known at the start of the scan will be reported right away using
+// accessPointFound(), signal strength changes of known ones using accessPointChanged(). The scan
+// is finished once NetworkManager updates the LastScan property of the wireless device.
+class WirelessScanManager : public QObject
+{
+    Q_OBJECT
+public:
+    enum ScanRequestResult {
+        ScanRequestResultStarted,
+        ScanRequestResultMerged,
+        ScanRequestResultCached,
+        ScanRequestResultUnavailable
+    };
+    Q_ENUM(ScanRequestResult)
+
+    explicit WirelessScanManager(NetworkManager *networkManager, QObject *parent = nullptr);
+
+    // Time in ms the access point list of the last scan will be considered fresh
+    int cacheTimeout() const;
+    void setCacheTimeout(int cacheTimeout);
+
+    // Time in ms a started scan will be finished after if NetworkManager does not update LastScan
+    int scanTimeout() const;
+    void setScanTimeout(int scanTimeout);
+
+    // Time in ms between checking the access point list for changes while scanning
+    int samplingInterval() const;
+    void setSamplingInterval(int samplingInterval);
+
+    bool scanning() const;
+    bool resultsFresh() const;
+
+    int scanCount() const;
+    int mergedRequestCount() const;
+    int cachedRequestCount() const;
+
+    // Number of access points which appeared during the last scan
+    int foundAccessPointCount() const;
+
+    ScanRequestResult requestScan();
+
+signals:
+    void accessPointFound(WirelessAccessPoint *accessPoint);
+    void accessPointChanged(WirelessAccessPoint *accessPoint);
+    void scanFinished();
+
+private:
+    NetworkManager *m_networkManager = nullptr;
+
+    int m_cacheTimeout = 10000;
+    int m_scanTimeout = 10000;
+    int m_samplingInterval = 250;
+
+    QTimer m_scanTimer;
+    QTimer m_samplingTimer;
+    // Signal strength of each access point as reported last, taken from the list at scan start
+    QHash<QString, int> m_signalStrengths;
+    int m_foundAccessPointCount = 0;
+    QElapsedTimer m_lastScanTimer;
+    QString m_scanDevicePath;
+
+    int m_scanCount = 0;
+    int m_mergedRequestCount = 0;
+    int m_cachedRequestCount = 0;
+
+    void finishScan();
+
+private slots:
+    void onScanTimeout();
+    void onDevicePropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties);
+    void onWirelessPropertiesChanged(const QVariantMap &changedProperties);
+    void sampleAccessPoints();
+
+};
+
+#endif // WIRELESSSCANMANAGER_H
@@ -29,20 +29,24 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "wirelessservice.h"
+#include "accesspointfilter.h"
 #include "loggingcategories.h"
 
 #include <QJsonDocument>
-#include <QNetworkInterface>
 #include <QLowEnergyDescriptorData>
 #include <QLowEnergyCharacteristicData>
 
-WirelessService::WirelessService(QLowEnergyService *service, NetworkManager *networkManager, QObject *parent) :
+WirelessService::WirelessService(QLowEnergyService *service, NetworkManager *networkManager, WirelessScanManager *scanManager, InterfaceAddressCache *addressCache, QObject *parent) :
     QObject(parent),
     m_service(service),
-    m_networkManager(networkManager)
+    m_networkManager(networkManager),
+    m_scanManager(scanManager),
+    m_addressCache(addressCache)
 {    
     qCDebug(dcNymeaBluetoothServer()) << "Create WirelessService.";
 
+    m_notifier = new CharacteristicNotifier(m_service, this);
+
     // Service
     connect(m_service, SIGNAL(characteristicChanged(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
     connect(m_service, SIGNAL(characteristicRead(QLowEnergyCharacteristic, QByteArray)), this, SLOT(characteristicChanged(QLowEnergyCharacteristic, QByteArray)));
@@ -68,6 +72,20 @@ QLowEnergyService *WirelessService::service()
     return m_service;
 }
 
+void WirelessService::setSession(BluetoothSession *session)
+{
+    m_session = session;
+    m_notifier->setSession(session);
+    if (!m_session.isNull()) {
+        m_session->loadClientConfigurations(m_service);
+    }
+}
+
+CharacteristicNotifier *WirelessService::notifier() const
+{
+    return m_notifier;
+}
+
 QLowEnergyServiceData WirelessService::serviceData(NetworkManager *networkManager)
 {
     QLowEnergyServiceData serviceData;
@@ -199,8 +217,12 @@ QByteArray WirelessService::getWirelessMode(WirelessNetworkDevice::WirelessMode
     return QByteArray::fromHex("00");
 }
 
-
 void WirelessService::streamData(const QVariantMap &responseMap)
+{
+    streamData(QJsonDocument::fromVariant(responseMap).toJson(QJsonDocument::Compact));
+}
+
+void WirelessService::streamData(const QByteArray &json)
 {
     QLowEnergyCharacteristic characteristic = m_service->characteristic(wirelessResponseCharacteristicUuid);
     if (!characteristic.isValid()) {
@@ -208,7 +230,7 @@ void WirelessService::streamData(const QVariantMap &responseMap)
         return;
     }
 
-    QByteArray data = QJsonDocument::fromVariant(responseMap).toJson(QJsonDocument::Compact) + '\n';
+    QByteArray data = json + '\n';
     qCDebug(dcNymeaBluetoothServer()) << "WirelessService: Start streaming response data:" << data.count() << "bytes";
 
     int sentDataLength = 0;
@@ -220,6 +242,9 @@ void WirelessService::streamData(const QVariantMap &responseMap)
         remainingData = remainingData.remove(0, package.count());
     }
 
+    if (!m_session.isNull())
+        m_session->notifyDataSent(sentDataLength);
+
     qCDebug(dcNymeaBluetoothServer()) << "WirelessService: Finished streaming response data";
 }
 
@@ -231,10 +256,32 @@ QVariantMap WirelessService::createResponse(const WirelessService::WirelessServi
     return response;
 }
 
-void WirelessService::commandGetNetworks(const QVariantMap &request)
+void WirelessService::beginResponse(JsonWriter &writer, const WirelessService::WirelessServiceCommand &command, const WirelessService::WirelessServiceResponse &responseCode)
 {
-    Q_UNUSED(request)
+    // Note: the caller has to write the "p" value and end the object
+    writer.beginObject();
+    writer.writeKey("c");
+    writer.writeValue(static_cast<int>(command));
+    writer.writeKey("r");
+    writer.writeValue(static_cast<int>(responseCode));
+}
 
+void WirelessService::writeAccessPoint(JsonWriter &writer, WirelessAccessPoint *accessPoint)
+{
+    writer.beginObject();
+    writer.writeKey("e");
+    writer.writeValue(accessPoint->ssid());
+    writer.writeKey("m");
+    writer.writeValue(accessPoint->macAddress());
+    writer.writeKey("s");
+    writer.writeValue(static_cast<int>(accessPoint->signalStrength()));
+    writer.writeKey("p");
+    writer.writeValue(static_cast<int>(accessPoint->isProtected()));
+    writer.endObject();
+}
+
+void WirelessService::commandGetNetworks(const QVariantMap &request)
+{
     if (!m_service) {
         qCWarning(dcNymeaBluetoothServer()) << "WirelessService: Could not stream wireless network list. Service not valid";
         return;
@@ -246,20 +293,19 @@ void WirelessService::commandGetNetworks(const QVariantMap &request)
         return;
     }
 
-    QVariantList accessPointVariantList;
-    foreach (WirelessAccessPoint *accessPoint, m_device->accessPoints()) {
-        QVariantMap accessPointVariantMap;
-        accessPointVariantMap.insert("e", accessPoint->ssid());
-        accessPointVariantMap.insert("m", accessPoint->macAddress());
-        accessPointVariantMap.insert("s", accessPoint->signalStrength());
-        accessPointVariantMap.insert("p", static_cast<int>(accessPoint->isProtected()));
-        accessPointVariantList.append(accessPointVariantMap);
+    // Note: write the list directly, an access point takes roughly 70 bytes
+    QList<WirelessAccessPoint *> accessPoints = AccessPointFilter::fromParams(QJsonObject::fromVariantMap(request.value("p").toMap())).apply(m_device->accessPoints());
+    JsonWriter writer(32 + 80 * accessPoints.count());
+    beginResponse(writer, WirelessServiceCommandGetNetworks);
+    writer.writeKey("p");
+    writer.beginArray();
+    foreach (WirelessAccessPoint *accessPoint, accessPoints) {
+        writeAccessPoint(writer, accessPoint);
     }
+    writer.endArray();
+    writer.endObject();
 
-    QVariantMap response = createResponse(WirelessServiceCommandGetNetworks);
-    response.insert("p", accessPointVariantList);
-
-    streamData(response);
+    streamData(writer.data());
 }
 
 void WirelessService::commandConnect(const QVariantMap &request)
@@ -348,7 +394,7 @@ void WirelessService::commandScan(const QVariantMap &request)
         return;
     }
 
-    m_device->scanWirelessNetworks();
+    m_scanManager->requestScan();
     streamData(createResponse(WirelessServiceCommandScan));
 }
 
@@ -367,36 +413,50 @@ void WirelessService::commandGetCurrentConnection(const QVariantMap &request)
         return;
     }
 
-    QVariantMap connectionDataMap;
-    QNetworkInterface wifiInterface = QNetworkInterface::interfaceFromName(m_device->interface());
-    if (!m_device->activeAccessPoint() || !wifiInterface.isValid() || wifiInterface.addressEntries().isEmpty()) {
+    JsonWriter writer;
+    beginResponse(writer, WirelessServiceCommandGetCurrentConnection);
+    writer.writeKey("p");
+    writer.beginObject();
+
+    QList<QNetworkAddressEntry> addressEntries = m_addressCache->addressEntries(m_device->interface());
+    if (!m_device->activeAccessPoint() || addressEntries.isEmpty()) {
         qCDebug(dcNymeaBluetoothServer()) << "There is currently no access active accesspoint";
-        connectionDataMap.insert("e", "");
-        connectionDataMap.insert("m", "");
-        connectionDataMap.insert("s", 0);
-        connectionDataMap.insert("p", 0);
-        connectionDataMap.insert("i", "");
+        writer.writeKey("e");
+        writer.writeValue("");
+        writer.writeKey("m");
+        writer.writeValue("");
+        writer.writeKey("s");
+        writer.writeValue(0);
+        writer.writeKey("p");
+        writer.writeValue(0);
+        writer.writeKey("i");
+        writer.writeValue("");
     } else {
         QHostAddress address;
         // Note: for now, we'll just use the first IPv4 address. However, in a future version
         // this should somehow pack all addresses, IPv4 and IPv6 ones.
-        foreach (const QNetworkAddressEntry &entry, wifiInterface.addressEntries()) {
+        foreach (const QNetworkAddressEntry &entry, addressEntries) {
             if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol) {
                 address = entry.ip();
                 break;
             }
         }
         qCDebug(dcNymeaBluetoothServer()) << "Current connection:" << m_device->activeAccessPoint() << address.toString();
-        connectionDataMap.insert("e", m_device->activeAccessPoint()->ssid());
-        connectionDataMap.insert("m", m_device->activeAccessPoint()->macAddress());
-        connectionDataMap.insert("s", m_device->activeAccessPoint()->signalStrength());
-        connectionDataMap.insert("p", static_cast<int>(m_device->activeAccessPoint()->isProtected()));
-        connectionDataMap.insert("i", address.toString());
-    }
-
-    QVariantMap response = createResponse(WirelessServiceCommandGetCurrentConnection);
-    response.insert("p", connectionDataMap);
-    streamData(response);
+        writer.writeKey("e");
+        writer.writeValue(m_device->activeAccessPoint()->ssid());
+        writer.writeKey("m");
+        writer.writeValue(m_device->activeAccessPoint()->macAddress());
+        writer.writeKey("s");
+        writer.writeValue(static_cast<int>(m_device->activeAccessPoint()->signalStrength()));
+        writer.writeKey("p");
+        writer.writeValue(static_cast<int>(m_device->activeAccessPoint()->isProtected()));
+        writer.writeKey("i");
+        writer.writeValue(address.toString());
+    }
+
+    writer.endObject();
+    writer.endObject();
+    streamData(writer.data());
 }
 
 void WirelessService::commandStartAccessPoint(const QVariantMap &request)
@@ -460,6 +520,9 @@ void WirelessService::characteristicChanged(const QLowEnergyCharacteristic &char
 {
     // Command
     if (characteristic.uuid() == wirelessCommanderCharacteristicUuid) {
+        if (!m_session.isNull())
+            m_session->notifyDataReceived(value.count());
+
         // Check if currently reading
         if (m_readingInputData) {
             m_inputDataStream.append(value);
@@ -515,6 +578,9 @@ void WirelessService::descriptorRead(const QLowEnergyDescriptor &descriptor, con
 void WirelessService::descriptorWritten(const QLowEnergyDescriptor &descriptor, const QByteArray &value)
 {
     qCDebug(dcNymeaBluetoothServer()) << "WirelessService: Descriptor written" << descriptor.uuid().toString() << value;
+    if (!m_session.isNull()) {
+        m_session->updateClientConfiguration(m_service, descriptor, value);
+    }
 }
 
 void WirelessService::serviceError(const QLowEnergyService::ServiceError &error)
@@ -615,13 +681,7 @@ void WirelessService::onWirelessDeviceStateChanged(const NetworkDevice::NetworkD
         return;
     }
 
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(wirelessStateCharacteristicUuid);
-    if (!characteristic.isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "WirelessService: Could not update wireless network device state. Characteristic not valid";
-        return;
-    }
-
-    m_service->writeCharacteristic(characteristic, WirelessService::getWirelessNetworkDeviceState(state));
+    m_notifier->notify(wirelessStateCharacteristicUuid, WirelessService::getWirelessNetworkDeviceState(state));
 }
 
 void WirelessService::onWirelessModeChanged(WirelessNetworkDevice::WirelessMode mode)
@@ -631,12 +691,6 @@ void WirelessService::onWirelessModeChanged(WirelessNetworkDevice::WirelessMode
         return;
     }
 
-    QLowEnergyCharacteristic characteristic = m_service->characteristic(wirelessModeCharacteristicUuid);
-    if (!characteristic.isValid()) {
-        qCWarning(dcNymeaBluetoothServer()) << "WirelessService: Could not update wireless device mode. Characteristic not valid";
-        return;
-    }
-
     qCDebug(dcNymeaBluetoothServer()) << "WirelessService: Notify wireless mode changed" << WirelessService::getWirelessMode(mode);
-    m_service->writeCharacteristic(characteristic, WirelessService::getWirelessMode(mode));
+    m_notifier->notify(wirelessModeCharacteristicUuid, WirelessService::getWirelessMode(mode));
 }
@@ -32,6 +32,7 @@
 #define WIRELESSSERVICE_H
 
 #include <QObject>
+#include <QPointer>
 #include <QVariantMap>
 #include <QLowEnergyService>
 #include <QLowEnergyServiceData>
@@ -40,6 +41,11 @@
 #include <wirelessaccesspoint.h>
 #include <wirelessnetworkdevice.h>
 
+#include "jsonwriter.h"
+#include "characteristicnotifier.h"
+#include "wirelessscanmanager.h"
+#include "interfaceaddresscache.h"
+
 static QBluetoothUuid wirelessServiceUuid =                 QBluetoothUuid(QUuid("e081fec0-f757-4449-b9c9-bfa83133f7fc"));
 static QBluetoothUuid wirelessCommanderCharacteristicUuid = QBluetoothUuid(QUuid("e081fec1-f757-4449-b9c9-bfa83133f7fc"));
 static QBluetoothUuid wirelessResponseCharacteristicUuid =  QBluetoothUuid(QUuid("e081fec2-f757-4449-b9c9-bfa83133f7fc"));
@@ -75,26 +81,38 @@ public:
     };
     Q_ENUM(WirelessServiceResponse)
 
-    explicit WirelessService(QLowEnergyService *service, NetworkManager *networkManager, QObject *parent = nullptr);
+    explicit WirelessService(QLowEnergyService *service, NetworkManager *networkManager, WirelessScanManager *scanManager, InterfaceAddressCache *addressCache, QObject *parent = nullptr);
     QLowEnergyService *service();
 
+    // The session of the connected client, responses will only be streamed if it enabled the notifications
+    void setSession(BluetoothSession *session);
+
+    // Conflates the notifications of the state and mode characteristics
+    CharacteristicNotifier *notifier() const;
+
     static QLowEnergyServiceData serviceData(NetworkManager *networkManager);
+    static QByteArray getWirelessMode(WirelessNetworkDevice::WirelessMode mode);
+    static QByteArray getWirelessNetworkDeviceState(const NetworkDevice::NetworkDeviceState &state);
 
 private:
     QLowEnergyService *m_service = nullptr;
     NetworkManager *m_networkManager = nullptr;
     WirelessNetworkDevice *m_device = nullptr;
+    WirelessScanManager *m_scanManager = nullptr;
+    InterfaceAddressCache *m_addressCache = nullptr;
+    CharacteristicNotifier *m_notifier = nullptr;
+    QPointer<BluetoothSession> m_session;
 
     bool m_readingInputData = false;
     QByteArray m_inputDataStream;
 
     WirelessServiceResponse checkWirelessErrors();
 
-    // Note: static to be available in serviceData
-    static QByteArray getWirelessNetworkDeviceState(const NetworkDevice::NetworkDeviceState &state);
-    static QByteArray getWirelessMode(WirelessNetworkDevice::WirelessMode mode);
-
     void streamData(const QVariantMap &responseMap);
+    void streamData(const QByteArray &json);
+
+    void beginResponse(JsonWriter &writer, const WirelessServiceCommand &command, const WirelessServiceResponse &responseCode = WirelessServiceResponseSuccess);
+    void writeAccessPoint(JsonWriter &writer, WirelessAccessPoint *accessPoint);
 
     QVariantMap createResponse(const WirelessServiceCommand &command, const WirelessServiceResponse &responseCode = WirelessServiceResponseSuccess);
 
@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = testconnectionparameterpolicy
+
+SOURCES += \
+    testconnectionparameterpolicy.cpp
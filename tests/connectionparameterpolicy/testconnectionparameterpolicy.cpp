@@ -0,0 +1,201 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QtTest>
+
+#include "connectionparameterpolicy.h"
+
+class TestConnectionParameterPolicy : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void disabled();
+    void fastOnStart();
+    void relaxedWhenIdle();
+    void activityKeepsFast();
+    void holdTimeDelaysFast();
+    void holdTimeDelaysRelaxed();
+    void stopResets();
+
+private:
+    ConnectionParameterPolicy *m_policy = nullptr;
+    QList<QLowEnergyConnectionParameters> m_requests;
+    qint64 m_now = 0;
+
+    void advance(qint64 msecs);
+
+};
+
+void TestConnectionParameterPolicy::init()
+{
+    m_now = 1000;
+    m_policy = new ConnectionParameterPolicy(this);
+    m_policy->setClock([this](){ return m_now; });
+    m_policy->setIdleTimeout(5000);
+    m_policy->setHoldTime(2000);
+    m_policy->setEnabled(true);
+    m_requests.clear();
+    connect(m_policy, &ConnectionParameterPolicy::connectionUpdateRequested, this, [this](const QLowEnergyConnectionParameters &parameters){
+        m_requests.append(parameters);
+    });
+}
+
+void TestConnectionParameterPolicy::cleanup()
+{
+    delete m_policy;
+    m_policy = nullptr;
+}
+
+void TestConnectionParameterPolicy::advance(qint64 msecs)
+{
+    // The internal timer calls update() once a deadline passed, the fake clock makes that explicit
+    m_now += msecs;
+    m_policy->update();
+}
+
+void TestConnectionParameterPolicy::disabled()
+{
+    m_policy->setEnabled(false);
+    m_policy->start();
+    m_policy->notifyActivity();
+    advance(10000);
+
+    QCOMPARE(m_requests.count(), 0);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeNone);
+}
+
+void TestConnectionParameterPolicy::fastOnStart()
+{
+    m_policy->start();
+
+    QCOMPARE(m_requests.count(), 1);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+    QCOMPARE(m_requests.at(0), m_policy->fastParameters());
+}
+
+void TestConnectionParameterPolicy::relaxedWhenIdle()
+{
+    m_policy->start();
+
+    advance(4999);
+    QCOMPARE(m_requests.count(), 1);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+
+    advance(1);
+    QCOMPARE(m_requests.count(), 2);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeRelaxed);
+    QCOMPARE(m_requests.at(1), m_policy->relaxedParameters());
+
+    // Staying idle does not repeat the request
+    advance(60000);
+    QCOMPARE(m_requests.count(), 2);
+}
+
+void TestConnectionParameterPolicy::activityKeepsFast()
+{
+    m_policy->start();
+
+    for (int i = 0; i < 10; i++) {
+        m_now += 3000;
+        m_policy->notifyActivity();
+        advance(0);
+    }
+
+    QCOMPARE(m_requests.count(), 1);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+}
+
+void TestConnectionParameterPolicy::holdTimeDelaysFast()
+{
+    m_policy->start();
+
+    advance(5000);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeRelaxed);
+    QCOMPARE(m_requests.count(), 2);
+
+    // The relaxed request is only 1 s old, the fast request has to wait for the hold time
+    m_now += 1000;
+    m_policy->notifyActivity();
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeRelaxed);
+    QCOMPARE(m_requests.count(), 2);
+
+    advance(999);
+    QCOMPARE(m_requests.count(), 2);
+
+    advance(1);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+    QCOMPARE(m_requests.count(), 3);
+}
+
+void TestConnectionParameterPolicy::holdTimeDelaysRelaxed()
+{
+    m_policy->setIdleTimeout(500);
+    m_policy->start();
+
+    // Idle before the hold time of the fast request passed
+    advance(500);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+    QCOMPARE(m_requests.count(), 1);
+
+    // Activity during the hold time cancels the pending change
+    m_now += 1000;
+    m_policy->notifyActivity();
+    advance(499);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+    QCOMPARE(m_requests.count(), 1);
+
+    // Idle again, the hold time passed now
+    advance(1);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeRelaxed);
+    QCOMPARE(m_requests.count(), 2);
+}
+
+void TestConnectionParameterPolicy::stopResets()
+{
+    m_policy->start();
+    m_policy->stop();
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeNone);
+
+    advance(10000);
+    QCOMPARE(m_requests.count(), 1);
+
+    // A new connection starts fast again without waiting for the hold time of the old one
+    m_policy->start();
+    QCOMPARE(m_requests.count(), 2);
+    QCOMPARE(m_policy->mode(), ConnectionParameterPolicy::ModeFast);
+}
+
+QTEST_GUILESS_MAIN(TestConnectionParameterPolicy)
+
+#include "testconnectionparameterpolicy.moc"
@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = testjsonwriter
+
+SOURCES += \
+    testjsonwriter.cpp
@@ -0,0 +1,248 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QtTest>
+#include <QJsonDocument>
+
+#include <atomic>
+#include <stdlib.h>
+
+#include "jsonwriter.h"
+
+// Count the heap allocations of the whole process, including the ones of the Qt libraries
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static std::atomic<long> s_allocations(0);
+
+extern "C" void *malloc(size_t size) __THROW
+{
+    s_allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) __THROW
+{
+    s_allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) __THROW
+{
+    s_allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+struct AccessPoint {
+    QString ssid;
+    QString macAddress;
+    int signalStrength;
+    bool isProtected;
+};
+
+class TestJsonWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void writeValues();
+    void escapeStrings();
+
+    void responseEqualsVariantResponse();
+    void responseAllocations();
+
+    void benchmarkVariantResponse();
+    void benchmarkWriterResponse();
+
+private:
+    QList<AccessPoint> m_accessPoints;
+
+    QByteArray variantResponse() const;
+    QByteArray writerResponse() const;
+
+};
+
+void TestJsonWriter::initTestCase()
+{
+    // A typical list of visible networks
+    for (int i = 0; i < 50; i++) {
+        AccessPoint accessPoint;
+        accessPoint.ssid = QString("Network %1").arg(i);
+        accessPoint.macAddress = QString("00:11:22:33:44:%1").arg(i, 2, 10, QChar('0'));
+        accessPoint.signalStrength = 30 + i;
+        accessPoint.isProtected = i % 2;
+        m_accessPoints.append(accessPoint);
+    }
+}
+
+void TestJsonWriter::writeValues()
+{
+    JsonWriter writer;
+    writer.beginObject();
+    writer.writeKey("i");
+    writer.writeValue(-42);
+    writer.writeKey("l");
+    writer.writeValue(static_cast<qint64>(1) << 40);
+    writer.writeKey("b");
+    writer.writeValue(true);
+    writer.writeKey("n");
+    writer.writeNull();
+    writer.writeKey("a");
+    writer.beginArray();
+    writer.writeValue("x");
+    writer.beginObject();
+    writer.endObject();
+    writer.beginArray();
+    writer.endArray();
+    writer.endArray();
+    writer.writeKey("r");
+    writer.writeRawValue("{\"k\":1}");
+    writer.endObject();
+
+    QCOMPARE(writer.data(), QByteArray("{\"i\":-42,\"l\":1099511627776,\"b\":true,\"n\":null,\"a\":[\"x\",{},[]],\"r\":{\"k\":1}}"));
+}
+
+void TestJsonWriter::escapeStrings()
+{
+    QString value = QString::fromUtf8("\"quoted\" back\\slash\n\t\x01 \xc3\xa4");
+
+    JsonWriter writer;
+    writer.beginArray();
+    writer.writeValue(value);
+    writer.endArray();
+
+    QJsonParseError error;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(writer.data(), &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+    QCOMPARE(jsonDoc.array().at(0).toString(), value);
+}
+
+void TestJsonWriter::responseEqualsVariantResponse()
+{
+    QCOMPARE(QJsonDocument::fromJson(writerResponse()), QJsonDocument::fromJson(variantResponse()));
+}
+
+void TestJsonWriter::responseAllocations()
+{
+    // Warm up lazily initialized data of Qt
+    variantResponse();
+    writerResponse();
+
+    long allocations = s_allocations;
+    QByteArray variantData = variantResponse();
+    long variantAllocations = s_allocations - allocations;
+
+    allocations = s_allocations;
+    QByteArray writerData = writerResponse();
+    long writerAllocations = s_allocations - allocations;
+
+    qInfo() << "Heap allocations for a response with" << m_accessPoints.count() << "access points:"
+            << "QVariantMap" << variantAllocations << "JsonWriter" << writerAllocations;
+
+    QVERIFY(writerAllocations > 0);
+    QVERIFY(writerAllocations < variantAllocations);
+}
+
+void TestJsonWriter::benchmarkVariantResponse()
+{
+    QBENCHMARK {
+        variantResponse();
+    }
+}
+
+void TestJsonWriter::benchmarkWriterResponse()
+{
+    QBENCHMARK {
+        writerResponse();
+    }
+}
+
+QByteArray TestJsonWriter::variantResponse() const
+{
+    QVariantList accessPoints;
+    foreach (const AccessPoint &accessPoint, m_accessPoints) {
+        QVariantMap accessPointMap;
+        accessPointMap.insert("e", accessPoint.ssid);
+        accessPointMap.insert("m", accessPoint.macAddress);
+        accessPointMap.insert("s", accessPoint.signalStrength);
+        accessPointMap.insert("p", static_cast<int>(accessPoint.isProtected));
+        accessPoints.append(accessPointMap);
+    }
+
+    QVariantMap params;
+    params.insert("a", accessPoints);
+
+    QVariantMap response;
+    response.insert("c", 0);
+    response.insert("r", 0);
+    response.insert("p", params);
+    return QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact);
+}
+
+QByteArray TestJsonWriter::writerResponse() const
+{
+    JsonWriter params(32 + 80 * m_accessPoints.count());
+    params.beginObject();
+    params.writeKey("a");
+    params.beginArray();
+    foreach (const AccessPoint &accessPoint, m_accessPoints) {
+        params.beginObject();
+        params.writeKey("e");
+        params.writeValue(accessPoint.ssid);
+        params.writeKey("m");
+        params.writeValue(accessPoint.macAddress);
+        params.writeKey("s");
+        params.writeValue(accessPoint.signalStrength);
+        params.writeKey("p");
+        params.writeValue(static_cast<int>(accessPoint.isProtected));
+        params.endObject();
+    }
+    params.endArray();
+    params.endObject();
+
+    // Same as BluetoothService::sendResponse
+    JsonWriter response;
+    response.beginObject();
+    response.writeKey("c");
+    response.writeValue(0);
+    response.writeKey("r");
+    response.writeValue(0);
+    response.writeKey("p");
+    response.writeRawValue(params.data());
+    response.endObject();
+    return response.data();
+}
+
+QTEST_GUILESS_MAIN(TestJsonWriter)
+
+#include "testjsonwriter.moc"
@@ -0,0 +1,18 @@
+QT -= gui
+QT += testlib bluetooth dbus network
+
+QMAKE_CXXFLAGS *= -Werror -std=c++11 -g
+QMAKE_LFLAGS *= -std=c++11
+
+CONFIG += testcase no_testcase_installs link_pkgconfig
+PKGCONFIG += nymea-networkmanager libsodium
+
+INCLUDEPATH += $$PWD/../libnymea-bluetoothserver $$PWD/common
+LIBS += -L$$OUT_PWD/../../libnymea-bluetoothserver -lnymea-bluetoothserver
+QMAKE_RPATHDIR += $$OUT_PWD/../../libnymea-bluetoothserver
+
+SOURCES += \
+    $$PWD/common/mocklinksecurityprovider.cpp
+
+HEADERS += \
+    $$PWD/common/mocklinksecurityprovider.h
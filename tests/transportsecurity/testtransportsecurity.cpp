@@ -0,0 +1,150 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2021, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of libnymea-bluetoothserver.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU Lesser General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; version 3. This project is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QtTest>
+
+#include "bluetoothsession.h"
+#include "bluetoothservicedatahandler.h"
+#include "mocklinksecurityprovider.h"
+
+class TestTransportSecurity : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void selectTransportSecurity_data();
+    void selectTransportSecurity();
+
+    void sessionLinkSecurity();
+    void sessionWithoutProvider();
+
+};
+
+void TestTransportSecurity::selectTransportSecurity_data()
+{
+    QTest::addColumn<bool>("useEncryption");
+    QTest::addColumn<BluetoothService::EncryptionPolicy>("encryptionPolicy");
+    QTest::addColumn<bool>("encryptionReady");
+    QTest::addColumn<LinkSecurityProvider::LinkSecurity>("linkSecurity");
+    QTest::addColumn<BluetoothServiceDataHandler::TransportSecurity>("transportSecurity");
+
+    QTest::newRow("unencrypted service")
+            << false << BluetoothService::EncryptionPolicyApplication << false << LinkSecurityProvider::LinkSecurityNone
+            << BluetoothServiceDataHandler::TransportSecurityPlain;
+    QTest::newRow("unencrypted service, encryption ready")
+            << false << BluetoothService::EncryptionPolicyLinkLayerSufficient << true << LinkSecurityProvider::LinkSecurityAuthenticated
+            << BluetoothServiceDataHandler::TransportSecurityPlain;
+
+    QTest::newRow("application policy, no encryption")
+            << true << BluetoothService::EncryptionPolicyApplication << false << LinkSecurityProvider::LinkSecurityNone
+            << BluetoothServiceDataHandler::TransportSecurityInsufficient;
+    QTest::newRow("application policy, authenticated link")
+            << true << BluetoothService::EncryptionPolicyApplication << false << LinkSecurityProvider::LinkSecurityAuthenticated
+            << BluetoothServiceDataHandler::TransportSecurityInsufficient;
+    QTest::newRow("application policy, encryption ready")
+            << true << BluetoothService::EncryptionPolicyApplication << true << LinkSecurityProvider::LinkSecurityNone
+            << BluetoothServiceDataHandler::TransportSecurityApplication;
+
+    QTest::newRow("link layer policy, no encryption")
+            << true << BluetoothService::EncryptionPolicyLinkLayerSufficient << false << LinkSecurityProvider::LinkSecurityNone
+            << BluetoothServiceDataHandler::TransportSecurityInsufficient;
+    QTest::newRow("link layer policy, unauthenticated link")
+            << true << BluetoothService::EncryptionPolicyLinkLayerSufficient << false << LinkSecurityProvider::LinkSecurityEncrypted
+            << BluetoothServiceDataHandler::TransportSecurityInsufficient;
+    QTest::newRow("link layer policy, authenticated link")
+            << true << BluetoothService::EncryptionPolicyLinkLayerSufficient << false << LinkSecurityProvider::LinkSecurityAuthenticated
+            << BluetoothServiceDataHandler::TransportSecurityLinkLayer;
+    QTest::newRow("link layer policy, authenticated link, encryption ready")
+            << true << BluetoothService::EncryptionPolicyLinkLayerSufficient << true << LinkSecurityProvider::LinkSecurityAuthenticated
+            << BluetoothServiceDataHandler::TransportSecurityApplication;
+}
+
+void TestTransportSecurity::selectTransportSecurity()
+{
+    QFETCH(bool, useEncryption);
+    QFETCH(BluetoothService::EncryptionPolicy, encryptionPolicy);
+    QFETCH(bool, encryptionReady);
+    QFETCH(LinkSecurityProvider::LinkSecurity, linkSecurity);
+    QFETCH(BluetoothServiceDataHandler::TransportSecurity, transportSecurity);
+
+    QCOMPARE(BluetoothServiceDataHandler::selectTransportSecurity(useEncryption, encryptionPolicy, encryptionReady, linkSecurity), transportSecurity);
+}
+
+void TestTransportSecurity::sessionLinkSecurity()
+{
+    QBluetoothAddress remoteAddress("11:22:33:44:55:66");
+    MockLinkSecurityProvider provider;
+    BluetoothSession session(remoteAddress);
+    session.setLinkSecurityProvider(&provider);
+
+    // The client connected without pairing
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityNone);
+    QCOMPARE(BluetoothServiceDataHandler::selectTransportSecurity(true, BluetoothService::EncryptionPolicyLinkLayerSufficient, false, session.linkSecurity()),
+             BluetoothServiceDataHandler::TransportSecurityInsufficient);
+
+    // Other connections do not matter
+    provider.setLinkSecurity(QBluetoothAddress("66:55:44:33:22:11"), LinkSecurityProvider::LinkSecurityAuthenticated);
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityNone);
+
+    // The client encrypted the link without authentication
+    provider.setLinkSecurity(remoteAddress, LinkSecurityProvider::LinkSecurityEncrypted);
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityEncrypted);
+    QCOMPARE(BluetoothServiceDataHandler::selectTransportSecurity(true, BluetoothService::EncryptionPolicyLinkLayerSufficient, false, session.linkSecurity()),
+             BluetoothServiceDataHandler::TransportSecurityInsufficient);
+
+    // The client paired during the connection
+    provider.setLinkSecurity(remoteAddress, LinkSecurityProvider::LinkSecurityAuthenticated);
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityAuthenticated);
+    QCOMPARE(BluetoothServiceDataHandler::selectTransportSecurity(true, BluetoothService::EncryptionPolicyLinkLayerSufficient, false, session.linkSecurity()),
+             BluetoothServiceDataHandler::TransportSecurityLinkLayer);
+
+    // An authenticated link will not be read again
+    int queryCount = provider.queryCount();
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityAuthenticated);
+    QCOMPARE(provider.queryCount(), queryCount);
+}
+
+void TestTransportSecurity::sessionWithoutProvider()
+{
+    BluetoothSession session(QBluetoothAddress("11:22:33:44:55:66"));
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityNone);
+
+    MockLinkSecurityProvider *provider = new MockLinkSecurityProvider();
+    provider->setLinkSecurity(session.remoteAddress(), LinkSecurityProvider::LinkSecurityAuthenticated);
+    session.setLinkSecurityProvider(provider);
+    delete provider;
+
+    // The session does not own the provider
+    QCOMPARE(session.linkSecurity(), LinkSecurityProvider::LinkSecurityNone);
+}
+
+QTEST_GUILESS_MAIN(TestTransportSecurity)
+
+#include "testtransportsecurity.moc"
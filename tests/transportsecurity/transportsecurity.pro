@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = testtransportsecurity
+
+SOURCES += \
+    testtransportsecurity.cpp